@@ -0,0 +1,50 @@
+#include <cmath>
+#include <cstdlib>
+
+#include "../src/scene_constructor.hpp"
+
+// TO RUN: make scene SCENE=scenes/many_spheres.cpp
+// Synthetic scene for benchmarking acceleration structures
+// NUM_SPHERES small spheres (default 1000, override with -DNUM_SPHERES=...)
+// scattered over a 4x4 area above a gray plane at z = 0
+// Cam at (0, -2.5, 1.2) looking towards (0, 1, -0.3)
+// Point lights at (-2, -2, 3) and (2, -1, 2)
+
+#ifndef NUM_SPHERES
+#define NUM_SPHERES 1000
+#endif
+
+int main() {
+    // Create scene components
+    auto camera = cam(Point(0.0f, -2.5f, 1.2f), Vector(0.0f, 1.0f, -0.3f));
+    auto scr = screen(10.0f, 10.0f);
+    auto scn = scene(camera, scr, 0.3f, 0.5f, 8.0f, rgb(135, 206, 235));
+
+    // A few materials to cycle through
+    BasicMaterial materials[] = {
+        mat(rgb(220, 60, 60), 0.2f),
+        mat(rgb(60, 200, 90), 0.1f),
+        mat(rgb(70, 90, 230), 0.5f),
+        mat(rgb(230, 200, 60), 0.0f)
+    };
+
+    // Fixed seed, so that every run renders the same scene
+    std::srand(221);
+    auto random = [](float lo, float hi) {
+        return lo + (hi - lo) * ((float)std::rand() / RAND_MAX);
+    };
+    // Keep the density roughly constant as the count grows
+    float radius = 0.6f / std::sqrt((float)NUM_SPHERES);
+    for (int i = 0; i < NUM_SPHERES; i++) {
+        Point center(random(-2.0f, 2.0f), random(-2.0f, 2.0f), random(radius, 1.5f));
+        sphere(center, radius * random(0.5f, 1.5f), materials[i % 4], scn);
+    }
+    plane(Point(0.0f, 0.0f, 0.0f), Vector(0.0f, 0.0f, 1.0f), mat(rgb(200, 200, 200), 0.3f), scn);
+
+    // Add point lights to the scene
+    scn.add_light<BasicPointLight>(Point(-2.0, -2.0, 3.0), rgb(255, 255, 255));
+    scn.add_light<BasicPointLight>(Point(2.0, -1.0, 2.0), rgb(120, 120, 140));
+
+    handle_input(scn);
+    return 0;
+}
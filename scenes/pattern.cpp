@@ -30,7 +30,7 @@ int main() {
     // Add a plane with reflectivity pattern
     auto pattern = [](float a, float b) {
         float t = (std::sin(10 * a) + std::sin(10 * b) + 2) / 4;
-        return std::make_unique<BasicMaterial>(rgb(0, 0, 0), t);
+        return BasicMaterial(rgb(0, 0, 0), t);
     };
     scn.add_shape(std::make_unique<ParametricPlane<decltype(pattern)>>(
         Point(0.0f, 0.0f, -0.1f),
@@ -12,7 +12,7 @@
 class SoccerBall : public Sphere {
 public:
     SoccerBall(Point center, float radius);
-    std::unique_ptr<Material> material_at(Point const&) const override;
+    Material const& material_at(Point const&, MaterialStorage&) const override;
 };
 
 SoccerBall::SoccerBall(Point center, float radius)
@@ -51,7 +51,7 @@ const std::array<int, 5> adjs[12] = {
     { 9, 2, 5, 7, 3 }
 };
 
-std::unique_ptr<Material> SoccerBall::material_at(Point const& point) const {
+Material const& SoccerBall::material_at(Point const& point, MaterialStorage& storage) const {
     Vector coord = !(point - this->center);
     Color color = Color::white();
     for (int i = 0; i < 12; i++) {
@@ -78,7 +78,7 @@ std::unique_ptr<Material> SoccerBall::material_at(Point const& point) const {
         }
     }
 
-    return std::make_unique<PBRMaterial>(color, 0.2f, 0);
+    return storage.emplace<PBRMaterial>(color, 0.2f, 0);
 }
 
 int main() {
@@ -128,7 +128,7 @@ int main() {
     };
     auto pattern = [&](float a, float b) {
         float t = (noise(a * 20, b * 20) + 1) / 2;
-        return std::make_unique<PBRMaterial>(rgb(0, 255, 0) * t, 0.5, 0);
+        return PBRMaterial(rgb(0, 255, 0) * t, 0.5, 0);
     };
     scn.add_shape(std::make_unique<ParametricPlane<decltype(pattern)>>(
         Point(0.0f, 0.0f, 0.0f),
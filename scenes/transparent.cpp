@@ -22,7 +22,7 @@ int main() {
     // Add a plane with color grid pattern
     auto pattern = [](float a, float b) {
         int t = std::abs((int)std::floor(10 * a) + (int)std::floor(10 * b)) % 2;
-        return std::make_unique<BasicMaterial>(t * rgb(255, 0, 0) + (1 - t) * rgb(0, 0, 255), 0.2f);
+        return BasicMaterial(t * rgb(255, 0, 0) + (1 - t) * rgb(0, 0, 255), 0.2f);
     };
     scn.add_shape(std::make_unique<ParametricPlane<decltype(pattern)>>(
         Point(0.0f, 0.0f, -0.5f),
@@ -0,0 +1,33 @@
+#include "aabb.hpp"
+
+AABB::AABB(Point min, Point max)
+    : min(min)
+    , max(max) {
+}
+
+AABB AABB::empty() {
+    float inf = std::numeric_limits<float>::infinity();
+    return AABB(Point(inf, inf, inf), Point(-inf, -inf, -inf));
+}
+
+void AABB::expand(AABB const& other) {
+    this->expand(other.min);
+    this->expand(other.max);
+}
+
+void AABB::expand(Point const& point) {
+    this->min = Point(std::min(this->min.x, point.x), std::min(this->min.y, point.y), std::min(this->min.z, point.z));
+    this->max = Point(std::max(this->max.x, point.x), std::max(this->max.y, point.y), std::max(this->max.z, point.z));
+}
+
+Point AABB::centroid() const {
+    return this->min + 0.5f * (this->max - this->min);
+}
+
+float AABB::surface_area() const {
+    Vector d = this->max - this->min;
+    if (d.x < 0 || d.y < 0 || d.z < 0) {
+        return 0.0f; // empty box
+    }
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "packet.hpp"
+#include "ray.hpp"
+#include "vector.hpp"
+
+/**
+ * @brief Axis-aligned bounding box, given by its minimum and maximum corners.
+ */
+class AABB {
+public:
+    Point min;
+    Point max;
+
+    AABB(Point min, Point max);
+
+    /**
+     * @brief An empty box, i.e., the identity of `expand()`.
+     */
+    static AABB empty();
+
+    void expand(AABB const& other); // Grow (in-place) to contain `other`
+    void expand(Point const& point); // Grow (in-place) to contain `point`
+    Point centroid() const;
+    float surface_area() const;
+
+    /**
+     * @brief Slab test of a ray against the box.
+     * @param ray The ray
+     * @param inv_dir Componentwise reciprocal of `ray.direction`, computed
+     * once per ray by the caller
+     * @param t_max Intersections with parameter larger than `t_max` are ignored
+     * @return Whether the ray enters the box at some `t` in `[0, t_max]`
+     */
+    bool intersects(Ray const& ray, Vector const& inv_dir, float t_max) const;
+
+    /**
+     * @brief Slab test of every lane of a packet against the box; same as
+     * `intersects()` lane by lane. Inactive lanes are not masked out.
+     */
+    PacketMask intersects(RayPacket const& packet, PacketFloat const inv_dir[3], PacketFloat t_max) const;
+};
+
+// Hot in BVH traversal, so defined in the header to allow inlining
+
+inline bool AABB::intersects(Ray const& ray, Vector const& inv_dir, float t_max) const {
+    float tx1 = (this->min.x - ray.origin.x) * inv_dir.x;
+    float tx2 = (this->max.x - ray.origin.x) * inv_dir.x;
+    float t_enter = std::min(tx1, tx2);
+    float t_exit = std::max(tx1, tx2);
+
+    float ty1 = (this->min.y - ray.origin.y) * inv_dir.y;
+    float ty2 = (this->max.y - ray.origin.y) * inv_dir.y;
+    t_enter = std::max(t_enter, std::min(ty1, ty2));
+    t_exit = std::min(t_exit, std::max(ty1, ty2));
+
+    float tz1 = (this->min.z - ray.origin.z) * inv_dir.z;
+    float tz2 = (this->max.z - ray.origin.z) * inv_dir.z;
+    t_enter = std::max(t_enter, std::min(tz1, tz2));
+    t_exit = std::min(t_exit, std::max(tz1, tz2));
+
+    return t_exit >= std::max(t_enter, 0.0f) && t_enter <= t_max;
+}
+
+inline PacketMask AABB::intersects(RayPacket const& packet, PacketFloat const inv_dir[3], PacketFloat t_max) const {
+    PacketFloat tx1 = (this->min.x - packet.ox) * inv_dir[0];
+    PacketFloat tx2 = (this->max.x - packet.ox) * inv_dir[0];
+    PacketFloat t_enter = packet_min(tx1, tx2);
+    PacketFloat t_exit = packet_max(tx1, tx2);
+
+    PacketFloat ty1 = (this->min.y - packet.oy) * inv_dir[1];
+    PacketFloat ty2 = (this->max.y - packet.oy) * inv_dir[1];
+    t_enter = packet_max(t_enter, packet_min(ty1, ty2));
+    t_exit = packet_min(t_exit, packet_max(ty1, ty2));
+
+    PacketFloat tz1 = (this->min.z - packet.oz) * inv_dir[2];
+    PacketFloat tz2 = (this->max.z - packet.oz) * inv_dir[2];
+    t_enter = packet_max(t_enter, packet_min(tz1, tz2));
+    t_exit = packet_min(t_exit, packet_max(tz1, tz2));
+
+    PacketFloat zero {};
+    return (t_exit >= packet_max(t_enter, zero)) & (t_enter <= t_max);
+}
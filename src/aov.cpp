@@ -0,0 +1,156 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "aov.hpp"
+
+uint16_t float_to_half(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000) {
+        // Infinity, or a quiet NaN
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477FF000) {
+        return sign | 0x7C00; // rounds past 65504, the largest half
+    }
+    if (magnitude < 0x38800000) {
+        // Below 2^-14, halves are multiples of 2^-24, which this is exactly
+        // scaled by; rounding up from the largest lands on the smallest normal
+        float scaled;
+        std::memcpy(&scaled, &magnitude, sizeof(scaled));
+        return sign | (uint16_t)std::nearbyint(scaled * 16777216.0f);
+    }
+    // Rebias the exponent from 127 to 15, and round the 23 bits of the
+    // mantissa to 10, ties to even; a carry moves to the exponent
+    uint32_t rebiased = magnitude - ((127 - 15) << 23);
+    rebiased += 0xFFF + ((rebiased >> 13) & 1);
+    return sign | (uint16_t)(rebiased >> 13);
+}
+
+float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+        float magnitude = mantissa * 5.9604645e-8f; // 2^-24
+        return sign ? -magnitude : magnitude;
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | mantissa << 13;
+    } else {
+        bits = sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+    }
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+void AOVPlane::reset(std::size_t size, AOVPrecision precision, float value) {
+    this->precision = precision;
+    if (precision == AOVPrecision::Half) {
+        this->full.clear();
+        this->half.assign(size, float_to_half(value));
+    } else {
+        this->half.clear();
+        this->full.assign(size, value);
+    }
+}
+
+void AOVPlane::clear() {
+    this->full.clear();
+    this->half.clear();
+}
+
+bool AOVPlane::empty() const {
+    return this->full.empty() && this->half.empty();
+}
+
+std::size_t AOVPlane::bytes() const {
+    return this->full.size() * sizeof(float) + this->half.size() * sizeof(uint16_t);
+}
+
+AOVBuffers::AOVBuffers(AOVSettings const& settings)
+    : settings(settings) {
+}
+
+void AOVBuffers::reset(int width, int height) {
+    std::size_t size = (std::size_t)width * height;
+    AOVPrecision precision = this->settings.precision;
+    this->width = width;
+    this->height = height;
+    auto reset_planes = [&](std::array<AOVPlane, 3>& planes, bool on) {
+        for (AOVPlane& plane : planes) {
+            if (on) {
+                plane.reset(size, precision, 0.0f);
+            } else {
+                plane.clear();
+            }
+        }
+    };
+    if (this->settings.depth) {
+        this->depth.reset(size, precision, std::numeric_limits<float>::infinity());
+    } else {
+        this->depth.clear();
+    }
+    reset_planes(this->position, this->settings.position);
+    reset_planes(this->normal, this->settings.normal);
+    this->shape_id.assign(this->settings.shape_id ? size : 0, 0);
+    reset_planes(this->albedo, this->settings.albedo);
+    reset_planes(this->direct, this->settings.lighting);
+    reset_planes(this->indirect, this->settings.lighting);
+}
+
+std::size_t AOVBuffers::bytes() const {
+    std::size_t total = this->depth.bytes() + this->shape_id.size() * sizeof(uint32_t);
+    for (auto const* planes : { &this->position, &this->normal, &this->albedo, &this->direct, &this->indirect }) {
+        for (AOVPlane const& plane : *planes) {
+            total += plane.bytes();
+        }
+    }
+    return total;
+}
+
+void AOVBuffers::set_hit(std::size_t p, float t, Point const& position, Vector const& normal, uint32_t shape_id,
+    Color const& albedo) {
+    if (this->settings.depth) {
+        this->depth.set(p, t);
+    }
+    if (this->settings.position) {
+        this->position[0].set(p, position.x);
+        this->position[1].set(p, position.y);
+        this->position[2].set(p, position.z);
+    }
+    if (this->settings.normal) {
+        this->normal[0].set(p, normal.x);
+        this->normal[1].set(p, normal.y);
+        this->normal[2].set(p, normal.z);
+    }
+    if (this->settings.shape_id) {
+        this->shape_id[p] = shape_id;
+    }
+    if (this->settings.albedo) {
+        auto channels = albedo.get_raw();
+        for (int c = 0; c < 3; c++) {
+            this->albedo[c].set(p, channels[c]);
+        }
+    }
+}
+
+void AOVBuffers::set_lighting(std::size_t p, Color const& direct, Color const& indirect) {
+    if (!this->settings.lighting) {
+        return;
+    }
+    auto direct_channels = direct.get_raw();
+    auto indirect_channels = indirect.get_raw();
+    for (int c = 0; c < 3; c++) {
+        this->direct[c].set(p, direct_channels[c]);
+        this->indirect[c].set(p, indirect_channels[c]);
+    }
+}
+
+Color AOVBuffers::get_color(std::array<AOVPlane, 3> const& planes, std::size_t p) {
+    return Color::raw(planes[0].get(p), planes[1].get(p), planes[2].get(p));
+}
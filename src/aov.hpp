@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "color.hpp"
+#include "vector.hpp"
+
+/**
+ * @brief How each channel of an `AOVPlane` is stored.
+ */
+enum class AOVPrecision {
+    Float, // 32-bit floats
+    // 16-bit IEEE half floats: 11 significant bits, up to 65504; enough for
+    // colors and normals, but depth and position lose about 1/2048 of
+    // their magnitude
+    Half
+};
+
+// IEEE half float conversions, rounding to nearest even
+uint16_t float_to_half(float x);
+float half_to_float(uint16_t h);
+
+/**
+ * @brief One channel of one output variable, one value per pixel laid out
+ * like the image, stored at the chosen precision.
+ */
+class AOVPlane {
+private:
+    AOVPrecision precision = AOVPrecision::Float;
+    std::vector<float> full; // with `AOVPrecision::Float`
+    std::vector<uint16_t> half; // with `AOVPrecision::Half`
+
+public:
+    // Hold `size` values equal to `value`
+    void reset(std::size_t size, AOVPrecision precision, float value);
+    void clear(); // hold nothing
+    bool empty() const;
+    std::size_t bytes() const;
+
+    float get(std::size_t i) const;
+    void set(std::size_t i, float value);
+};
+
+/**
+ * @brief Which output variables `SceneBase::render_aovs()` fills in, and
+ * how precisely. Variables that are off take no memory.
+ */
+struct AOVSettings {
+    bool depth = true; // parameter `t` of the primary hit; infinity where nothing is hit
+    bool position = false; // world position of the primary hit; zero where nothing is hit
+    bool normal = true; // unit, facing the camera; zero where nothing is hit
+    bool shape_id = true; // see `Shape::get_id()`; 0 where nothing is hit
+    bool albedo = true; // see `Material::albedo()`; black where nothing is hit
+    // The color of the primary ray, split into what is shaded at its hit
+    // (ambient and lights) and what comes back along secondary rays
+    // (reflections and refractions); the sky is direct
+    bool lighting = false;
+    AOVPrecision precision = AOVPrecision::Float; // of every plane but `shape_id`
+};
+
+/**
+ * @brief Arbitrary output variables of a frame: what the primary ray of
+ * each pixel hits, for compositing, denoising, relighting and retoning
+ * without tracing the scene again. Every variable is split into one plane
+ * per channel (e.g., `normal[1]` is the y coordinate of the normals), laid
+ * out like the image.
+ */
+struct AOVBuffers {
+    AOVSettings settings;
+    int width = 0;
+    int height = 0;
+    AOVPlane depth;
+    std::array<AOVPlane, 3> position;
+    std::array<AOVPlane, 3> normal;
+    std::vector<uint32_t> shape_id;
+    std::array<AOVPlane, 3> albedo;
+    // `direct + indirect` is the color of the primary ray through the
+    // center of the pixel, before antialiasing, denoising and clamping
+    // (which a pixel saturates past 1)
+    std::array<AOVPlane, 3> direct;
+    std::array<AOVPlane, 3> indirect;
+
+    AOVBuffers() = default;
+    explicit AOVBuffers(AOVSettings const& settings);
+
+    // Resize the variables `settings` asks for to `width` by `height`
+    // pixels, all of them hitting nothing, and clear the others
+    void reset(int width, int height);
+    std::size_t bytes() const; // taken by the planes
+
+    // Store the primary hit of pixel `p`, for the variables that are on
+    void set_hit(std::size_t p, float t, Point const& position, Vector const& normal, uint32_t shape_id,
+        Color const& albedo);
+    void set_lighting(std::size_t p, Color const& direct, Color const& indirect);
+
+    // Color of pixel `p` in `planes` (e.g., `albedo`)
+    static Color get_color(std::array<AOVPlane, 3> const& planes, std::size_t p);
+};
+
+// Inline definitions
+
+inline float AOVPlane::get(std::size_t i) const {
+    return this->precision == AOVPrecision::Half ? half_to_float(this->half[i]) : this->full[i];
+}
+
+inline void AOVPlane::set(std::size_t i, float value) {
+    if (this->precision == AOVPrecision::Half) {
+        this->half[i] = float_to_half(value);
+    } else {
+        this->full[i] = value;
+    }
+}
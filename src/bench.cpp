@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include <omp.h>
+
+#include "bench.hpp"
+#include "image.hpp"
+
+BenchConfig BenchConfig::from_environment() {
+    BenchConfig config;
+    if (char const* name = std::getenv("BENCH_NAME")) {
+        config.name = name;
+    }
+    if (char const* width = std::getenv("BENCH_WIDTH")) {
+        config.width = std::max(1, std::atoi(width));
+    }
+    if (char const* height = std::getenv("BENCH_HEIGHT")) {
+        config.height = std::max(1, std::atoi(height));
+    }
+    if (char const* threads = std::getenv("BENCH_THREADS")) {
+        std::vector<int> list;
+        std::istringstream stream(threads);
+        int n;
+        while (stream >> n) {
+            if (n > 0) {
+                list.push_back(n);
+            }
+        }
+        if (!list.empty()) {
+            config.threads = list;
+        }
+    }
+    if (char const* repeats = std::getenv("BENCH_REPEATS")) {
+        config.repeats = std::max(1, std::atoi(repeats));
+    }
+    if (char const* image = std::getenv("BENCH_IMAGE")) {
+        config.image = image;
+    }
+    return config;
+}
+
+std::string BenchConfig::image_path(int threads) const {
+    std::size_t slash = this->image.find_last_of('/');
+    std::size_t dot = this->image.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = this->image.size(); // no extension
+    }
+    return this->image.substr(0, dot) + "-" + std::to_string(threads) + this->image.substr(dot);
+}
+
+// Escape a string for use inside JSON quotes
+std::string json_escape(std::string const& str) {
+    std::string result;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+std::string run_benchmark(SceneBase const& scene, BenchConfig const& config) {
+    struct Result {
+        int threads;
+        double mean_ms;
+        double min_ms;
+        double variance_ms2;
+        double rays;
+    };
+    std::vector<Result> results;
+    ImageWriter writer;
+    bool written = true;
+
+    int saved_threads = omp_get_max_threads();
+    for (int threads : config.threads) {
+        omp_set_num_threads(threads);
+        // Warm-up: builds the BVH and touches all the memory once
+        scene.render(config.width, config.height);
+
+        std::vector<double> times;
+        RenderStats stats;
+        std::vector<Color> frame;
+        for (int r = 0; r < config.repeats; r++) {
+            auto start_time = std::chrono::steady_clock::now();
+            frame = scene.render(config.width, config.height, &stats);
+            auto end_time = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::milli>(end_time - start_time).count());
+        }
+        if (!config.image.empty()) {
+            written &= writer.wait(); // the previous frame's
+            writer.submit(config.image_path(threads), std::move(frame), config.width, config.height);
+        }
+
+        double mean = 0.0;
+        for (double t : times) {
+            mean += t;
+        }
+        mean /= times.size();
+        double variance = 0.0;
+        for (double t : times) {
+            variance += (t - mean) * (t - mean);
+        }
+        variance /= times.size();
+        double min = *std::min_element(times.begin(), times.end());
+        // Without stats, only primary rays can be counted
+        double rays = RenderStats::kEnabled ? (double)stats.counters.total_rays()
+                                            : (double)config.width * config.height;
+        results.push_back(Result { threads, mean, min, variance, rays });
+    }
+    omp_set_num_threads(saved_threads);
+    if (!config.image.empty() && !(writer.wait() && written)) {
+        std::cerr << "Failed to write " << config.image << std::endl;
+    }
+
+    // Scaling efficiency is relative to the run with the fewest threads
+    Result const* base = nullptr;
+    for (Result const& result : results) {
+        if (!base || result.threads < base->threads) {
+            base = &result;
+        }
+    }
+
+    std::ostringstream json;
+    json << "{\"scene\": \"" << json_escape(config.name) << "\", "
+         << "\"width\": " << config.width << ", "
+         << "\"height\": " << config.height << ", "
+         << "\"repeats\": " << config.repeats << ", "
+         << "\"rays_counted\": \"" << (RenderStats::kEnabled ? "all" : "primary") << "\", "
+         << "\"results\": [";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        Result const& result = results[i];
+        double efficiency = (base->mean_ms * base->threads) / (result.mean_ms * result.threads);
+        json << (i > 0 ? ", " : "")
+             << "{\"threads\": " << result.threads << ", "
+             << "\"mean_ms\": " << result.mean_ms << ", "
+             << "\"min_ms\": " << result.min_ms << ", "
+             << "\"variance_ms2\": " << result.variance_ms2 << ", "
+             << "\"stddev_ms\": " << std::sqrt(result.variance_ms2) << ", "
+             << "\"mrays_per_s\": " << result.rays / (result.mean_ms * 1e3) << ", "
+             << "\"scaling_efficiency\": " << efficiency << "}";
+    }
+    json << "]}";
+    return json.str();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "scene.hpp"
+
+/**
+ * @brief Parameters of a benchmark run.
+ */
+struct BenchConfig {
+    std::string name = "scene"; // reported in the output
+    int width = 320;
+    int height = 320;
+    std::vector<int> threads = { 1, 2, 4 }; // thread counts to measure
+    int repeats = 5; // timed renders per thread count, after one warm-up
+    // If not empty, where to write the last frame of each thread count,
+    // with the count inserted before the extension (see `image_path()`)
+    std::string image;
+
+    /**
+     * @brief Read the configuration from environment variables, keeping
+     * the defaults for unset ones: `BENCH_NAME`, `BENCH_WIDTH`,
+     * `BENCH_HEIGHT`, `BENCH_THREADS` (space-separated list),
+     * `BENCH_REPEATS` and `BENCH_IMAGE`. Used by `make bench`.
+     */
+    static BenchConfig from_environment();
+
+    // `image` for `threads` threads, e.g., `out-4.png` for `out.png`
+    std::string image_path(int threads) const;
+};
+
+/**
+ * @brief Render the scene from its current camera for every thread count
+ * in the configuration and measure the time per frame. Frames are written
+ * with an `ImageWriter`, so each is saved while the next thread count
+ * warms up.
+ * @return A JSON object with, for each thread count, the mean, minimum,
+ * variance and standard deviation of the frame time in milliseconds, the
+ * throughput in million rays per second, and the scaling efficiency
+ * relative to the smallest thread count.
+ */
+std::string run_benchmark(SceneBase const& scene, BenchConfig const& config);
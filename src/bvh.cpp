@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "bvh.hpp"
+
+// Component of a point along an axis (0 = x, 1 = y, 2 = z)
+float axis_of(Point const& point, int axis) {
+    return axis == 0 ? point.x : (axis == 1 ? point.y : point.z);
+}
+
+void BVH::build(std::vector<AABB> const& bounds) {
+    this->nodes.clear();
+    this->indices.clear();
+    if (bounds.empty()) {
+        return;
+    }
+
+    std::vector<Point> centroids;
+    centroids.reserve(bounds.size());
+    this->indices.reserve(bounds.size());
+    for (std::size_t i = 0; i < bounds.size(); i++) {
+        centroids.push_back(bounds[i].centroid());
+        this->indices.push_back(i);
+    }
+    // A binary tree has fewer than twice as many nodes as leaves
+    this->nodes.reserve(2 * bounds.size());
+    this->build_node(bounds, centroids, 0, bounds.size(), 0);
+}
+
+bool BVH::empty() const {
+    return this->nodes.empty();
+}
+
+std::vector<int> const& BVH::leaf_order() const {
+    return this->indices;
+}
+
+int BVH::build_node(std::vector<AABB> const& bounds, std::vector<Point> const& centroids, int first, int count, int depth) {
+    int node_index = this->nodes.size();
+    this->nodes.push_back(Node { AABB::empty(), first, count, 0 });
+
+    AABB node_bounds = AABB::empty();
+    AABB centroid_bounds = AABB::empty();
+    for (int i = first; i < first + count; i++) {
+        node_bounds.expand(bounds[this->indices[i]]);
+        centroid_bounds.expand(centroids[this->indices[i]]);
+    }
+    this->nodes[node_index].bounds = node_bounds;
+
+    // Leave the space between `BVH::kStackSize` and the depth for the
+    // traversal stack (each level pushes at most one extra entry)
+    if (count <= kMaxLeafSize || depth >= kStackSize - 2) {
+        return node_index;
+    }
+
+    // Binned surface area heuristic: on each axis, drop the centroids into
+    // `kBins` equal bins and evaluate the cost of splitting between bins
+    struct Bin {
+        AABB bounds = AABB::empty();
+        int count = 0;
+    };
+    float best_cost = std::numeric_limits<float>::infinity();
+    int best_axis = -1;
+    int best_split = 0; // bins [0, best_split) go to the left child
+    for (int axis = 0; axis < 3; axis++) {
+        float lo = axis_of(centroid_bounds.min, axis);
+        float hi = axis_of(centroid_bounds.max, axis);
+        if (hi <= lo) {
+            continue; // all centroids coincide along this axis
+        }
+        float scale = kBins / (hi - lo);
+        std::array<Bin, kBins> bins;
+        for (int i = first; i < first + count; i++) {
+            int b = std::min(kBins - 1, (int)((axis_of(centroids[this->indices[i]], axis) - lo) * scale));
+            bins[b].bounds.expand(bounds[this->indices[i]]);
+            bins[b].count++;
+        }
+
+        // Sweep from the right to get the area and count right of each split
+        std::array<float, kBins> right_area;
+        std::array<int, kBins> right_count;
+        AABB acc = AABB::empty();
+        int acc_count = 0;
+        for (int b = kBins - 1; b > 0; b--) {
+            acc.expand(bins[b].bounds);
+            acc_count += bins[b].count;
+            right_area[b] = acc.surface_area();
+            right_count[b] = acc_count;
+        }
+        // Sweep from the left and evaluate each split
+        acc = AABB::empty();
+        acc_count = 0;
+        for (int b = 1; b < kBins; b++) {
+            acc.expand(bins[b - 1].bounds);
+            acc_count += bins[b - 1].count;
+            if (acc_count == 0 || right_count[b] == 0) {
+                continue;
+            }
+            float cost = acc.surface_area() * acc_count + right_area[b] * right_count[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    if (best_axis < 0) {
+        return node_index; // centroids coincide; no split separates them
+    }
+    // Compare against the cost of intersecting every primitive in a leaf
+    // (traversal cost taken to be the same as intersection cost), but
+    // don't let leaves grow too large
+    float leaf_cost = node_bounds.surface_area() * count;
+    if (best_cost + node_bounds.surface_area() >= leaf_cost && count <= 2 * kMaxLeafSize) {
+        return node_index;
+    }
+
+    float lo = axis_of(centroid_bounds.min, best_axis);
+    float scale = kBins / (axis_of(centroid_bounds.max, best_axis) - lo);
+    int* split = std::partition(
+        this->indices.data() + first, this->indices.data() + first + count,
+        [&](int index) {
+            int b = std::min(kBins - 1, (int)((axis_of(centroids[index], best_axis) - lo) * scale));
+            return b < best_split;
+        });
+    int mid = split - this->indices.data();
+
+    this->nodes[node_index].axis = best_axis;
+    this->nodes[node_index].count = 0;
+    this->build_node(bounds, centroids, first, mid - first, depth + 1);
+    int right = this->build_node(bounds, centroids, mid, first + count - mid, depth + 1);
+    this->nodes[node_index].first = right;
+    return node_index;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <vector>
+
+#include "aabb.hpp"
+#include "packet.hpp"
+#include "ray.hpp"
+#include "vector.hpp"
+
+/**
+ * @brief Bounding volume hierarchy over a list of bounding boxes.
+ *
+ * The hierarchy only knows about boxes; primitives are referred to by
+ * their index in the list passed to `build()`, and the caller decides
+ * what to do when a ray reaches a primitive (see `traverse()`).
+ */
+class BVH {
+private:
+    // Nodes are stored depth-first, so the left child of an interior node
+    // immediately follows the node itself
+    struct Node {
+        AABB bounds;
+        int first; // leaf: first entry in `indices`; interior: index of the right child
+        int count; // leaf: number of primitives; interior: 0
+        int axis; // interior: split axis, used to visit the nearer child first
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> indices; // primitive indices, grouped by leaf
+
+    int build_node(std::vector<AABB> const& bounds, std::vector<Point> const& centroids, int first, int count, int depth);
+
+public:
+    static constexpr int kBins = 12; // number of SAH bins per axis
+    static constexpr int kMaxLeafSize = 4;
+    static constexpr int kStackSize = 64; // traversal stack; the tree is never deeper than this
+
+    BVH() = default;
+
+    /**
+     * @brief Build the hierarchy with binned surface area heuristic.
+     * @param bounds Bounding box of each primitive
+     */
+    void build(std::vector<AABB> const& bounds);
+
+    bool empty() const;
+
+    /**
+     * @return The primitive index at each position of the leaves: leaf
+     * ranges passed to `traverse_leaves()` refer to this order. Callers
+     * that lay out their primitives in this order get contiguous leaves.
+     */
+    std::vector<int> const& leaf_order() const;
+
+    /**
+     * @brief Visit every primitive whose bounding box the ray may hit,
+     * nearer subtrees first.
+     * @param ray The ray
+     * @param t_max Boxes entered after `t_max` are skipped. `visit` may
+     * reduce it (e.g., after a closer hit is found) to prune the rest of
+     * the traversal.
+     * @param visit Called as `visit(index)` with the primitive index; the
+     * traversal stops as soon as it returns `true`
+     * @return Whether the traversal was stopped by `visit`
+     */
+    template <typename Func>
+    bool traverse(Ray const& ray, float& t_max, Func&& visit) const;
+
+    /**
+     * @brief Same as `traverse()`, but `visit(first, count)` is called once
+     * per leaf with positions `first` to `first + count - 1` in `leaf_order()`.
+     */
+    template <typename Func>
+    bool traverse_leaves(Ray const& ray, float& t_max, Func&& visit) const;
+
+    /**
+     * @brief Visit every primitive whose bounding box some active lane of
+     * the packet may hit. Works best for coherent rays (e.g., neighboring
+     * primary rays), which mostly visit the same nodes.
+     * @param packet The rays
+     * @param t_max Per-lane version of `t_max` in `traverse()`; it is read
+     * again at every node, so `visit` may reduce it
+     * @param visit Called as `visit(index)` with the primitive index
+     */
+    template <typename Func>
+    void traverse_packet(RayPacket const& packet, PacketFloat const& t_max, Func&& visit) const;
+
+    /**
+     * @brief Same as `traverse_packet()`, but called once per leaf as in
+     * `traverse_leaves()`.
+     */
+    template <typename Func>
+    void traverse_packet_leaves(RayPacket const& packet, PacketFloat const& t_max, Func&& visit) const;
+};
+
+// Template definition; must be put or otherwise included in the header
+
+template <typename Func>
+bool BVH::traverse(Ray const& ray, float& t_max, Func&& visit) const {
+    return this->traverse_leaves(ray, t_max, [&](int first, int count) {
+        for (int i = first; i < first + count; i++) {
+            if (visit(this->indices[i])) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+template <typename Func>
+bool BVH::traverse_leaves(Ray const& ray, float& t_max, Func&& visit) const {
+    if (this->nodes.empty()) {
+        return false;
+    }
+    Vector inv_dir(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    bool dir_negative[3] = { inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0 };
+
+    int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        Node const& node = this->nodes[stack[--top]];
+        if (!node.bounds.intersects(ray, inv_dir, t_max)) {
+            continue;
+        }
+        if (node.count > 0) {
+            if (visit(node.first, node.count)) {
+                return true;
+            }
+            continue;
+        }
+        int left = &node - this->nodes.data() + 1;
+        int right = node.first;
+        // Push the farther child first so that the nearer one is popped next
+        if (dir_negative[node.axis]) {
+            stack[top++] = left;
+            stack[top++] = right;
+        } else {
+            stack[top++] = right;
+            stack[top++] = left;
+        }
+    }
+    return false;
+}
+
+template <typename Func>
+void BVH::traverse_packet(RayPacket const& packet, PacketFloat const& t_max, Func&& visit) const {
+    this->traverse_packet_leaves(packet, t_max, [&](int first, int count) {
+        for (int i = first; i < first + count; i++) {
+            visit(this->indices[i]);
+        }
+    });
+}
+
+template <typename Func>
+void BVH::traverse_packet_leaves(RayPacket const& packet, PacketFloat const& t_max, Func&& visit) const {
+    if (this->nodes.empty()) {
+        return;
+    }
+    PacketFloat inv_dir[3] = { 1.0f / packet.dx, 1.0f / packet.dy, 1.0f / packet.dz };
+    // Near-first order is decided by the first lane; the rays are assumed
+    // to go in roughly the same direction
+    bool dir_negative[3] = { packet.dx[0] < 0, packet.dy[0] < 0, packet.dz[0] < 0 };
+
+    int stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        Node const& node = this->nodes[stack[--top]];
+        if (!packet_any(packet.active & node.bounds.intersects(packet, inv_dir, t_max))) {
+            continue;
+        }
+        if (node.count > 0) {
+            visit(node.first, node.count);
+            continue;
+        }
+        int left = &node - this->nodes.data() + 1;
+        int right = node.first;
+        if (dir_negative[node.axis]) {
+            stack[top++] = left;
+            stack[top++] = right;
+        } else {
+            stack[top++] = right;
+            stack[top++] = left;
+        }
+    }
+}
@@ -41,6 +41,14 @@ std::array<float, 3> Color::get_rgb(float gamma) const {
     return { inv_gamma_correction(this->r, gamma), inv_gamma_correction(this->g, gamma), inv_gamma_correction(this->b, gamma) };
 }
 
+std::array<float, 3> Color::get_raw() const {
+    return { this->r, this->g, this->b };
+}
+
+float Color::luminance() const {
+    return 0.2126f * this->r + 0.7152f * this->g + 0.0722f * this->b;
+}
+
 void Color::clamp() {
     this->r = std::clamp(this->r, 0.0f, 1.0f);
     this->g = std::clamp(this->g, 0.0f, 1.0f);
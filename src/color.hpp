@@ -34,7 +34,9 @@ public:
     // Create a color representing white (multiplicative identity)
     static Color white();
     void clamp(); // Clamp color values to valid range (in-place)
+    float luminance() const; // Perceived brightness of the internal representation (Rec. 709)
     std::array<float, 3> get_rgb(float gamma = 2.2f) const; // Get array to RGB values
+    std::array<float, 3> get_raw() const; // Internal representation, as passed to Color::raw()
     friend Color operator+(Color const&, Color const&); // Color addition
     friend Color operator-(Color const&, Color const&); // Color subtraction
     friend Color operator*(Color const&, float); // Color scaling
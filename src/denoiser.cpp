@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+
+#include "denoiser.hpp"
+#include "packet.hpp"
+
+// Albedos are clamped to this before dividing by them, so that lighting
+// stays finite on black surfaces
+constexpr float kMinAlbedo = 1.0f / 64;
+
+/**
+ * @brief The image and its guides, one plane per channel, with a margin of
+ * pixels around the window that hit nothing, so that every tap of every
+ * round can be loaded without bounds checks.
+ */
+struct DenoiserPlanes {
+    int margin; // pixels on every side
+    int stride; // floats per row
+    // Lighting, or the color where nothing was hit
+    std::array<std::vector<float>, 3> lighting;
+    std::array<std::vector<float>, 3> albedo;
+    std::array<std::vector<float>, 3> normal;
+    std::vector<float> depth; // infinity where nothing was hit
+
+    DenoiserPlanes(int width, int height, int margin);
+    std::size_t index(int x, int y) const; // of pixel `(x, y)` of the window
+};
+
+DenoiserPlanes::DenoiserPlanes(int width, int height, int margin)
+    : margin(margin) {
+    // Rows are rounded up to whole packets, and the extra pixels hit nothing
+    int packets = (width + kPacketSize - 1) / kPacketSize;
+    this->stride = packets * kPacketSize + 2 * margin;
+    std::size_t size = (std::size_t)this->stride * (height + 2 * margin);
+    for (int c = 0; c < 3; c++) {
+        this->lighting[c].assign(size, 0.0f);
+        this->albedo[c].assign(size, 0.0f);
+        this->normal[c].assign(size, 0.0f);
+    }
+    this->depth.assign(size, std::numeric_limits<float>::infinity());
+}
+
+std::size_t DenoiserPlanes::index(int x, int y) const {
+    return (std::size_t)(y + this->margin) * this->stride + x + this->margin;
+}
+
+// `max(0, x)^power`, by repeated squaring
+PacketFloat packet_clamped_power(PacketFloat x, int power) {
+    PacketFloat base = packet_max(x, packet_broadcast(0.0f));
+    PacketFloat result = packet_broadcast(1.0f);
+    for (; power > 0; power >>= 1) {
+        if (power & 1) {
+            result *= base;
+        }
+        base *= base;
+    }
+    return result;
+}
+
+void denoise(std::vector<Color>& image, GBuffer const& gbuffer, Tile const& window, DenoiserSettings const& settings) {
+    int width = window.x1 - window.x0;
+    int height = window.y1 - window.y0;
+    int iterations = std::max(0, settings.iterations);
+    if (width <= 0 || height <= 0 || iterations == 0) {
+        return;
+    }
+    // The last round reaches 2 * 2^(iterations - 1) pixels away
+    DenoiserPlanes planes(width, height, 1 << iterations);
+    std::vector<float> albedo_factors[3]; // what lighting is multiplied by
+    for (int c = 0; c < 3; c++) {
+        albedo_factors[c].assign(planes.depth.size(), 1.0f);
+    }
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            std::size_t p = (std::size_t)(window.y0 + y) * gbuffer.width + window.x0 + x;
+            std::size_t q = planes.index(x, y);
+            auto color = image[p].get_raw();
+            if (!gbuffer.shape[p]) {
+                for (int c = 0; c < 3; c++) {
+                    planes.lighting[c][q] = color[c];
+                }
+                continue;
+            }
+            auto albedo = gbuffer.albedo[p].get_raw();
+            Vector const& normal = gbuffer.normal[p];
+            float normals[3] = { normal.x, normal.y, normal.z };
+            for (int c = 0; c < 3; c++) {
+                albedo_factors[c][q] = std::max(albedo[c], kMinAlbedo);
+                planes.lighting[c][q] = color[c] / albedo_factors[c][q];
+                planes.albedo[c][q] = albedo[c];
+                planes.normal[c][q] = normals[c];
+            }
+            planes.depth[q] = gbuffer.depth[p];
+        }
+    }
+
+    constexpr float kKernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 }; // B3 spline
+    std::array<std::vector<float>, 3> filtered = planes.lighting; // written by each round
+    float inv_albedo_sigma2 = 1.0f / (settings.albedo_sigma * settings.albedo_sigma);
+    for (int round = 0; round < iterations; round++) {
+        int step = 1 << round;
+        // Lighting gets smoother at each round, so its sigma is halved
+        float inv_color_sigma2 = (float)(step * step) / (settings.color_sigma * settings.color_sigma);
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x += kPacketSize) {
+                std::size_t p = planes.index(x, y);
+                PacketFloat lighting[3], albedo[3], normal[3];
+                for (int c = 0; c < 3; c++) {
+                    lighting[c] = packet_load(&planes.lighting[c][p]);
+                    albedo[c] = packet_load(&planes.albedo[c][p]);
+                    normal[c] = packet_load(&planes.normal[c][p]);
+                }
+                PacketFloat depth = packet_load(&planes.depth[p]);
+                PacketMask hit = depth < std::numeric_limits<float>::infinity();
+                if (!packet_any(hit)) {
+                    continue; // `filtered` already holds the color
+                }
+                PacketFloat inv_depth = 1.0f / depth;
+
+                // The center tap weighs the kernel alone
+                PacketFloat total_weight = packet_broadcast(kKernel[2] * kKernel[2]);
+                PacketFloat sum[3];
+                for (int c = 0; c < 3; c++) {
+                    sum[c] = total_weight * lighting[c];
+                }
+                for (int dy = -2; dy <= 2; dy++) {
+                    for (int dx = -2; dx <= 2; dx++) {
+                        if (dx == 0 && dy == 0) {
+                            continue;
+                        }
+                        std::size_t tap = p + (std::ptrdiff_t)dy * step * planes.stride + dx * step;
+                        PacketFloat exponent = packet_broadcast(0.0f);
+                        PacketFloat tap_lighting[3];
+                        PacketFloat cosine = packet_broadcast(0.0f);
+                        for (int c = 0; c < 3; c++) {
+                            tap_lighting[c] = packet_load(&planes.lighting[c][tap]);
+                            PacketFloat dl = tap_lighting[c] - lighting[c];
+                            PacketFloat da = packet_load(&planes.albedo[c][tap]) - albedo[c];
+                            exponent += dl * dl * inv_color_sigma2 + da * da * inv_albedo_sigma2;
+                            cosine += packet_load(&planes.normal[c][tap]) * normal[c];
+                        }
+                        // Sky lanes are discarded below, but their depths are
+                        // infinite, and `inf - inf` would feed a NaN to
+                        // `packet_exp()`, whose conversions are undefined on it
+                        PacketFloat zero = packet_broadcast(0.0f);
+                        PacketFloat dz = packet_load(&planes.depth[tap]) - depth;
+                        dz = hit ? packet_max(dz, -dz) : zero;
+                        float distance = (float)(step * std::max(std::abs(dx), std::abs(dy)));
+                        exponent += dz * inv_depth * (1.0f / (settings.depth_sigma * distance));
+                        exponent = hit ? exponent : zero;
+                        PacketFloat weight = kKernel[dy + 2] * kKernel[dx + 2] * packet_exp(-exponent)
+                            * packet_clamped_power(cosine, settings.normal_power);
+                        total_weight += weight;
+                        for (int c = 0; c < 3; c++) {
+                            sum[c] += weight * tap_lighting[c];
+                        }
+                    }
+                }
+                for (int c = 0; c < 3; c++) {
+                    PacketFloat result = hit ? sum[c] / total_weight : lighting[c];
+                    std::copy_n((float const*)&result, kPacketSize, &filtered[c][p]);
+                }
+            }
+        }
+        std::swap(planes.lighting, filtered);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            std::size_t p = (std::size_t)(window.y0 + y) * gbuffer.width + window.x0 + x;
+            if (!gbuffer.shape[p]) {
+                continue;
+            }
+            std::size_t q = planes.index(x, y);
+            Color color = Color::raw(planes.lighting[0][q] * albedo_factors[0][q],
+                planes.lighting[1][q] * albedo_factors[1][q],
+                planes.lighting[2][q] * albedo_factors[2][q]);
+            color.clamp();
+            image[p] = color;
+        }
+    }
+}
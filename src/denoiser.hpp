@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "color.hpp"
+#include "gbuffer.hpp"
+#include "scheduler.hpp"
+
+/**
+ * @brief Options of the denoiser (see `denoise()`). The sigmas set how
+ * different two pixels may be before they stop being averaged: the
+ * larger, the smoother (and blurrier) the image.
+ */
+struct DenoiserSettings {
+    bool enabled = false;
+    // Rounds of filtering; round `k` reaches `2^(k + 1)` pixels away
+    int iterations = 3;
+    // Difference in lighting (the color divided by the albedo, 1 being
+    // white), halved at each round as the noise goes down
+    float color_sigma = 0.5f;
+    float albedo_sigma = 0.1f; // difference in albedo
+    // Relative difference in depth, per pixel of distance between them
+    float depth_sigma = 0.02f;
+    // Normals count as `max(0, n_p * n_q)` raised to this power
+    int normal_power = 32;
+};
+
+/**
+ * @brief Filter the noise out of `image` in `window`, guided by `gbuffer`
+ * (laid out like `image`), in place.
+ *
+ * Edge-avoiding a-trous wavelet filter (Dammertz et al., "Edge-Avoiding
+ * A-Trous Wavelet Transform for Fast Global Illumination Filtering",
+ * HPG 2010): each round blurs the image with a 5x5 B3-spline kernel whose
+ * taps are spread twice as far apart as in the previous round, and weighs
+ * each tap down by how much its pixel differs in lighting, albedo, normal
+ * and depth. Lighting is filtered rather than color, so that textures stay
+ * sharp. Pixels where nothing was hit are left as they are, and are never
+ * mixed with the others.
+ *
+ * Runs on OpenMP threads, a row at a time, with `kPacketSize` pixels per
+ * instruction.
+ */
+void denoise(std::vector<Color>& image, GBuffer const& gbuffer, Tile const& window, DenoiserSettings const& settings);
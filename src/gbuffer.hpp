@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "color.hpp"
+#include "ray.hpp"
+#include "vector.hpp"
+
+class Shape;
+
+/**
+ * @brief What the primary ray of each pixel hits, one entry per pixel laid
+ * out like the image (see `SceneBase::render()`). Gathered by the render
+ * for adaptive antialiasing and for the denoiser.
+ *
+ * The render loops fill it in from the hits they shade anyway: right
+ * before shading the primary ray of a pixel, they point `active` and
+ * `pixel` at its entry, and the scene's `shade()` calls `record()`.
+ */
+struct GBuffer {
+    // G-buffer of the frame the calling thread renders, while the primary
+    // ray of entry `pixel` is being shaded; null otherwise
+    inline static thread_local GBuffer* active = nullptr;
+    inline static thread_local std::size_t pixel = 0;
+
+    int width = 0;
+    int height = 0;
+    std::vector<Shape const*> shape; // null where nothing is hit
+    // Parameter `t` of the hit along the primary ray (proportional to the
+    // distance from the camera); infinity where nothing is hit
+    std::vector<float> depth;
+    std::vector<Vector> normal; // unit, facing the camera; zero where nothing is hit
+    std::vector<Color> albedo; // see `Material::albedo()`; black where nothing is hit
+    // Color seen along the primary ray, before it is clamped to the image
+    std::vector<Color> radiance;
+
+    // Resize to `width` by `height` pixels, all of them hitting nothing
+    void reset(int width, int height);
+
+    // Make pixel `(i, j)` of `gbuffer` the active entry, or none if null
+    static void begin(GBuffer* gbuffer, int i, int j);
+    /**
+     * @brief Store the hit of `ray` at `t`, with the shape's `normal` and
+     * its material's albedo there, in the active entry, then deactivate
+     * it: the first hit shaded after `begin()` is the primary one, and
+     * those of secondary rays come after. Only call it while `active`.
+     */
+    static void record(Ray const& ray, float t, Shape const* shape, Vector const& normal, Color const& albedo);
+    // Store the color seen along the primary ray of pixel `(i, j)`, if
+    // `gbuffer` isn't null
+    static void record_radiance(GBuffer* gbuffer, int i, int j, Color const& color);
+};
+
+// Inline definitions
+
+inline void GBuffer::reset(int width, int height) {
+    std::size_t size = (std::size_t)width * height;
+    this->width = width;
+    this->height = height;
+    this->shape.assign(size, nullptr);
+    this->depth.assign(size, std::numeric_limits<float>::infinity());
+    this->normal.assign(size, Vector(0.0f, 0.0f, 0.0f));
+    this->albedo.assign(size, Color::black());
+    this->radiance.assign(size, Color::black());
+}
+
+inline void GBuffer::begin(GBuffer* gbuffer, int i, int j) {
+    GBuffer::active = gbuffer;
+    if (gbuffer) {
+        GBuffer::pixel = (std::size_t)i * gbuffer->width + j;
+    }
+}
+
+inline void GBuffer::record(Ray const& ray, float t, Shape const* shape, Vector const& normal, Color const& albedo) {
+    GBuffer& gbuffer = *GBuffer::active;
+    std::size_t p = GBuffer::pixel;
+    Vector unit = !normal;
+    gbuffer.shape[p] = shape;
+    gbuffer.depth[p] = t;
+    gbuffer.normal[p] = unit * ray.direction > 0 ? -unit : unit;
+    gbuffer.albedo[p] = albedo;
+    GBuffer::active = nullptr;
+}
+
+inline void GBuffer::record_radiance(GBuffer* gbuffer, int i, int j, Color const& color) {
+    if (gbuffer) {
+        gbuffer->radiance[(std::size_t)i * gbuffer->width + j] = color;
+    }
+}
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "image.hpp"
+
+ImageFormat image_format_from_path(std::string const& path) {
+    auto ends_with = [&](std::string const& suffix) {
+        return path.size() >= suffix.size()
+            && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".pfm")) {
+        return ImageFormat::PFM;
+    }
+    if (ends_with(".png")) {
+        return ImageFormat::PNG;
+    }
+    return ImageFormat::PPM;
+}
+
+// Append a string to the buffer at `pos`, returning the new position
+std::size_t put_string(std::vector<unsigned char>& buffer, std::size_t pos, std::string const& str) {
+    std::memcpy(buffer.data() + pos, str.data(), str.size());
+    return pos + str.size();
+}
+
+// Write a 32-bit big-endian integer (PNG byte order)
+void put_u32_be(unsigned char* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+// Convert a pixel to 8-bit sRGB, truncating like the old text writer
+void pixel_to_rgb8(Color const& color, unsigned char* out) {
+    std::array<float, 3> rgb = color.get_rgb();
+    for (int c = 0; c < 3; c++) {
+        out[c] = (unsigned char)rgb[c];
+    }
+}
+
+std::vector<unsigned char> encode_ppm(std::vector<Color> const& data, int width, int height) {
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    std::vector<unsigned char> buffer(header.size() + 3 * (std::size_t)width * height);
+    std::size_t base = put_string(buffer, 0, header);
+    #pragma omp parallel for
+    for (int i = 0; i < height; i++) {
+        unsigned char* row = buffer.data() + base + 3 * (std::size_t)i * width;
+        for (int j = 0; j < width; j++) {
+            pixel_to_rgb8(data[i * width + j], row + 3 * j);
+        }
+    }
+    return buffer;
+}
+
+std::vector<unsigned char> encode_pfm(std::vector<Color> const& data, int width, int height) {
+    // Negative scale means little-endian; rows go from the bottom up
+    std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    std::vector<unsigned char> buffer(header.size() + 3 * sizeof(float) * (std::size_t)width * height);
+    std::size_t base = put_string(buffer, 0, header);
+    #pragma omp parallel for
+    for (int i = 0; i < height; i++) {
+        unsigned char* row = buffer.data() + base + 3 * sizeof(float) * (std::size_t)(height - 1 - i) * width;
+        for (int j = 0; j < width; j++) {
+            // get_rgb() with gamma 1 is linear color scaled to [0, 255]
+            std::array<float, 3> rgb = data[i * width + j].get_rgb(1.0f);
+            for (int c = 0; c < 3; c++) {
+                float value = rgb[c] / 255.0f;
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                unsigned char* out = row + sizeof(float) * (3 * j + c);
+                out[0] = bits;
+                out[1] = bits >> 8;
+                out[2] = bits >> 16;
+                out[3] = bits >> 24;
+            }
+        }
+    }
+    return buffer;
+}
+
+// CRC-32 used by PNG chunks
+uint32_t png_crc(unsigned char const* data, std::size_t size) {
+    static std::array<uint32_t, 256> const table = [] {
+        std::array<uint32_t, 256> t {};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+std::vector<unsigned char> encode_png(std::vector<Color> const& data, int width, int height) {
+    // Image data is a zlib stream of "stored" (uncompressed) deflate blocks,
+    // each holding at most 65535 bytes of raw scanlines. Each scanline is a
+    // filter byte (0 = none) followed by the RGB bytes.
+    constexpr std::size_t kBlockSize = 65535;
+    std::size_t row_size = 1 + 3 * (std::size_t)width;
+    std::size_t raw_size = row_size * height;
+    std::size_t num_blocks = std::max<std::size_t>(1, (raw_size + kBlockSize - 1) / kBlockSize);
+    std::size_t zlib_size = 2 + raw_size + 5 * num_blocks + 4; // header, blocks, Adler-32
+
+    static unsigned char const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::size_t ihdr_size = 12 + 13;
+    std::size_t idat_size = 12 + zlib_size;
+    std::size_t iend_size = 12;
+    std::vector<unsigned char> buffer(sizeof(signature) + ihdr_size + idat_size + iend_size);
+    unsigned char* out = buffer.data();
+    std::memcpy(out, signature, sizeof(signature));
+
+    // IHDR: dimensions, 8 bits per channel, truecolor, no interlacing
+    unsigned char* ihdr = out + sizeof(signature);
+    put_u32_be(ihdr, 13);
+    std::memcpy(ihdr + 4, "IHDR", 4);
+    put_u32_be(ihdr + 8, width);
+    put_u32_be(ihdr + 12, height);
+    unsigned char const ihdr_rest[5] = { 8, 2, 0, 0, 0 };
+    std::memcpy(ihdr + 16, ihdr_rest, 5);
+    put_u32_be(ihdr + 21, png_crc(ihdr + 4, 17));
+
+    // IDAT
+    unsigned char* idat = ihdr + ihdr_size;
+    put_u32_be(idat, zlib_size);
+    std::memcpy(idat + 4, "IDAT", 4);
+    unsigned char* zlib = idat + 8;
+    zlib[0] = 0x78; // deflate, 32K window
+    zlib[1] = 0x01; // no preset dictionary, fastest; (0x78 << 8 | 0x01) % 31 == 0
+    unsigned char* blocks = zlib + 2;
+    // Raw byte `k` lands after the headers of the blocks up to and including its own
+    auto raw_at = [&](std::size_t k) {
+        return blocks + k + 5 * (k / kBlockSize + 1);
+    };
+    for (std::size_t b = 0; b < num_blocks; b++) {
+        std::size_t len = std::min(kBlockSize, raw_size - b * kBlockSize);
+        unsigned char* header = blocks + b * (kBlockSize + 5);
+        header[0] = (b + 1 == num_blocks) ? 1 : 0; // BFINAL, BTYPE = 00 (stored)
+        header[1] = len & 0xFF;
+        header[2] = len >> 8;
+        header[3] = ~len & 0xFF;
+        header[4] = (~len >> 8) & 0xFF;
+    }
+    #pragma omp parallel for
+    for (int i = 0; i < height; i++) {
+        std::size_t k = i * row_size;
+        *raw_at(k++) = 0; // filter type none
+        for (int j = 0; j < width; j++) {
+            unsigned char rgb[3];
+            pixel_to_rgb8(data[i * width + j], rgb);
+            for (int c = 0; c < 3; c++) {
+                *raw_at(k++) = rgb[c];
+            }
+        }
+    }
+    // Adler-32 of the raw data, processed in runs short enough not to overflow
+    uint32_t a = 1, b = 0;
+    for (std::size_t k = 0; k < raw_size;) {
+        std::size_t end = std::min(raw_size, (k / kBlockSize + 1) * kBlockSize);
+        unsigned char const* p = raw_at(k);
+        for (; k < end; k++) {
+            a += *p++;
+            b += a;
+            if ((k & 0xFFF) == 0xFFF) {
+                a %= 65521;
+                b %= 65521;
+            }
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    put_u32_be(zlib + zlib_size - 4, (b << 16) | a);
+    put_u32_be(idat + 8 + zlib_size, png_crc(idat + 4, 4 + zlib_size));
+
+    // IEND
+    unsigned char* iend = idat + idat_size;
+    put_u32_be(iend, 0);
+    std::memcpy(iend + 4, "IEND", 4);
+    put_u32_be(iend + 8, png_crc(iend + 4, 4));
+    return buffer;
+}
+
+std::vector<unsigned char> encode_image(std::vector<Color> const& data, int width, int height, ImageFormat format) {
+    switch (format) {
+        case ImageFormat::PFM:
+            return encode_pfm(data, width, height);
+        case ImageFormat::PNG:
+            return encode_png(data, width, height);
+        default:
+            return encode_ppm(data, width, height);
+    }
+}
+
+bool write_image(std::string const& path, std::vector<Color> const& data, int width, int height) {
+    std::vector<unsigned char> buffer = encode_image(data, width, height, image_format_from_path(path));
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+ImageWriter::~ImageWriter() {
+    this->wait();
+}
+
+void ImageWriter::submit(std::string path, std::vector<Color> data, int width, int height) {
+    this->wait();
+    this->worker = std::thread([this, path = std::move(path), data = std::move(data), width, height] {
+        this->last_ok = write_image(path, data, width, height);
+    });
+}
+
+bool ImageWriter::wait() {
+    if (this->worker.joinable()) {
+        this->worker.join();
+    }
+    return this->last_ok;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "color.hpp"
+
+/**
+ * @brief Supported image file formats.
+ */
+enum class ImageFormat {
+    PPM, // binary Netpbm (P6), 8-bit sRGB
+    PFM, // portable float map, 32-bit linear color
+    PNG // 8-bit sRGB, stored without compression
+};
+
+/**
+ * @brief Guess the format from the extension of `path` (`.ppm`, `.pfm` or
+ * `.png`, case-sensitive), defaulting to PPM.
+ */
+ImageFormat image_format_from_path(std::string const& path);
+
+/**
+ * @brief Encode an image into a buffer holding the whole file.
+ * @param data Colors as returned by `SceneBase::render()`, row by row from the top
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param format The file format
+ * @return The file contents. The buffer is allocated once with its final
+ * size, and rows are converted in parallel.
+ */
+std::vector<unsigned char> encode_image(std::vector<Color> const& data, int width, int height, ImageFormat format);
+
+/**
+ * @brief Encode an image in the format given by the extension of `path`
+ * and write it to `path` with a single write.
+ * @return Whether the file was written successfully
+ */
+bool write_image(std::string const& path, std::vector<Color> const& data, int width, int height);
+
+/**
+ * @brief Writes images on a background thread, so that rendering the next
+ * frame overlaps with encoding and disk I/O of the previous one. At most
+ * one write is in flight; `submit()` waits for the previous one first.
+ */
+class ImageWriter {
+private:
+    std::thread worker;
+    bool last_ok = true; // result of the last finished write
+
+public:
+    ImageWriter() = default;
+    ImageWriter(ImageWriter const&) = delete;
+    ImageWriter& operator=(ImageWriter const&) = delete;
+    ~ImageWriter(); // waits for the pending write
+
+    /**
+     * @brief Start writing an image in the background. Takes ownership of
+     * `data` so the caller can go on rendering into a new buffer.
+     */
+    void submit(std::string path, std::vector<Color> data, int width, int height);
+
+    /**
+     * @brief Wait for the pending write (if any) to finish.
+     * @return Whether the last write succeeded
+     */
+    bool wait();
+};
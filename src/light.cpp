@@ -8,12 +8,8 @@ Vector PointLight::get_direction(Point point) const {
     return this->position - point;
 }
 
-bool PointLight::is_visible(Point point, Scene const& scene) const {
-    auto intersection_info = scene.intersect_first_all(Ray(point, this->position - point));
-    if (intersection_info) {
-        return intersection_info.value().first > 1;
-    }
-    return true;
+Ray PointLight::shadow_ray(Point point) const {
+    return Ray(point, this->position - point);
 }
 
 BasicPointLight::BasicPointLight(Point position, Color color)
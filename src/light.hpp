@@ -1,12 +1,9 @@
 #pragma once
 
 #include "color.hpp"
-#include "scene.hpp"
+#include "ray.hpp"
 #include "vector.hpp"
 
-// Forward declaration
-class Scene;
-
 class Light {
 public:
     virtual ~Light() = default;
@@ -21,12 +18,12 @@ public:
      */
     virtual Vector get_direction(Point point) const = 0;
     /**
-     * @brief Check visibility of the light source from a point in a scene.
+     * @brief Get the ray along which visibility of the light source from a
+     * point is checked; the light is visible if nothing blocks the ray
+     * before it reaches the light at `t = 1` (see `SceneBase::occluded()`).
      * @param point The point.
-     * @param scene The scene.
-     * @return Whether the light is visible from the point.
      */
-    virtual bool is_visible(Point point, Scene const& scene) const = 0;
+    virtual Ray shadow_ray(Point point) const = 0;
 };
 
 /**
@@ -40,7 +37,7 @@ protected:
 public:
     PointLight(Point position);
     Vector get_direction(Point point) const override;
-    bool is_visible(Point point, Scene const& scene) const override;
+    Ray shadow_ray(Point point) const override;
 };
 
 /**
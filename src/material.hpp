@@ -1,11 +1,16 @@
 #pragma once
 
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 #include "color.hpp"
 #include "scene.hpp"
 #include "vector.hpp"
 
 // Forward declaration
-class Scene;
+class SceneBase;
 
 /**
  * Represent the shading behavior at a single point.
@@ -23,8 +28,79 @@ public:
      * towards the incoming ray)
      * @param scene the scene (required for light sources and tracing reflections)
      * @param recursion_depth maximum recursion depth allowed; 0 for no recursion
+     * @param weight how much the returned color contributes to the pixel;
+     * secondary rays multiply it by their own factor and pass it on to
+     * `SceneBase::trace_secondary()`, which uses it for pruning
+     * @note The materials in `materials/` implement this by calling a
+     * template `shade()` with the same parameters, which `StaticScene`
+     * calls directly with its own type to avoid virtual calls.
      */
     virtual Color get_color(
         Vector const& incoming, Point const& point, Vector const& normal,
-        Scene const* scene, int recursion_depth) const = 0;
+        SceneBase const* scene, int recursion_depth, float weight) const = 0;
+
+    /**
+     * @brief Fraction of the light the material scatters, per channel,
+     * i.e., its color under white light (see `GBuffer`). Lets the denoiser
+     * smooth lighting without smoothing textures. White by default.
+     */
+    virtual Color albedo() const;
 };
+
+/**
+ * @brief Inline storage for at most one material computed on the fly, e.g.,
+ * by a procedural pattern. Used by `Shape::material_at()` to hand out a
+ * material without allocating on the heap; owned by the caller (usually on
+ * the stack of `Scene::trace()`), so nested traces each have their own.
+ */
+class MaterialStorage {
+private:
+    static constexpr std::size_t kCapacity = 64; // enough for every material in the project
+    alignas(std::max_align_t) unsigned char buffer[kCapacity];
+    Material* material = nullptr; // the material living in `buffer`, if any
+
+    void reset();
+
+public:
+    MaterialStorage() = default;
+    MaterialStorage(MaterialStorage const&) = delete;
+    MaterialStorage& operator=(MaterialStorage const&) = delete;
+    ~MaterialStorage();
+
+    /**
+     * @brief Construct a material of type `T` in place, destroying the
+     * previously stored one (if any).
+     * @return A reference valid until the next call or until the storage
+     * is destroyed.
+     */
+    template <typename T, typename... Args>
+    T const& emplace(Args&&... args);
+};
+
+// Inline and template definitions; must be put or otherwise included in the header
+
+inline Color Material::albedo() const {
+    return Color::white();
+}
+
+inline void MaterialStorage::reset() {
+    if (this->material) {
+        this->material->~Material();
+        this->material = nullptr;
+    }
+}
+
+inline MaterialStorage::~MaterialStorage() {
+    this->reset();
+}
+
+template <typename T, typename... Args>
+inline T const& MaterialStorage::emplace(Args&&... args) {
+    static_assert(std::is_base_of_v<Material, T>, "T must be a Material");
+    static_assert(sizeof(T) <= kCapacity, "Material too large for MaterialStorage");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Material over-aligned for MaterialStorage");
+    this->reset();
+    T* result = new (this->buffer) T(std::forward<Args>(args)...);
+    this->material = result;
+    return *result;
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+
+#include "../light.hpp"
 #include "../material.hpp"
+#include "../stats.hpp"
 
 /**
  * An implementation of `Material` based on the minimal
@@ -15,5 +20,57 @@ public:
     BasicMaterial(Color, float);
     Color get_color(
         Vector const& incoming, Point const& point, Vector const& normal,
-        Scene const* scene, int recursion_depth) const override;
+        SceneBase const* scene, int recursion_depth, float weight) const override;
+    Color albedo() const override;
+
+    // `get_color()` for any scene type `SceneT`
+    template <typename SceneT>
+    Color shade(
+        Vector const& incoming, Point const& point, Vector const& normal,
+        SceneT const& scene, int recursion_depth, float weight) const;
 };
+
+// Template definition; must be put or otherwise included in the header
+
+template <typename SceneT>
+inline Color BasicMaterial::shade(
+    Vector const& incoming, Point const& point, Vector const& normal,
+    SceneT const& scene, int recursion_depth, float weight) const {
+    // Make sure the normal points in opposite direction from the incoming ray
+    Vector n = (normal * incoming > 0) ? -normal : normal;
+
+    float a = scene.get_ambient() * (1 - this->refl); // ambient light
+    Color l_ambient = this->color * a;
+    Color color = l_ambient; // tracks the total color
+
+    // iterate over the light sources
+    scene.for_each_visible_light(point + 1e-4 * n, n, [&](Light const& light) {
+        Color l_in = light.get_intensity(point); // amount of light into the point
+
+        // diffuse light
+        Vector lt = !light.get_direction(point); // unit vector pointing to the light source
+        Color l_diffuse = this->color * l_in * ((1 - a) * (1 - this->refl) * std::max(0.0f, n * lt));
+
+        // specular light
+        Vector h = !(lt - !incoming); // unit vector halfway between `incoming` and `lt`, pointing out
+        Color l_specular = scene.get_specular()
+            * std::pow(std::max(0.0f, h * n), scene.get_sp())
+            * l_in;
+
+        color = color + l_diffuse + l_specular;
+    });
+
+    // reflection, unless it contributes too little (see `SceneBase::path_scale()`)
+    float k_reflected = (1 - a) * this->refl;
+    if (this->refl > 0 && recursion_depth > 0) {
+        if (float scale = scene.path_scale(weight * k_reflected, recursion_depth); scale > 0) {
+            Vector reflected = incoming - 2.0f * (incoming >> n); // direction of reflected ray
+            STATS_ADD(reflection_rays, 1);
+            Color l_reflected = scene.trace_secondary(Ray(point + 1e-4 * n, reflected), recursion_depth - 1,
+                k_reflected * scale, weight * k_reflected * scale);
+            color = color + l_reflected;
+        }
+    }
+
+    return color;
+}
@@ -1,11 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <utility>
 
+#include "../light.hpp"
 #include "../material.hpp"
+#include "../sampler.hpp"
+#include "../stats.hpp"
+#include "../util.hpp"
+
+// Helpers of the Cook-Torrance model, used by `PBRMaterial::shade()`
+
+// Utility function, it's there just because it'll be called multiple times
+float geometry_schlick_ggx(float cos, float k);
+// Normal distribution function (Trowbridge-Reitz/GGX)
+float trowbridge_reitz(float a2, float cos_h);
+// Fresnel equation (Schlick approximation)
+Color fresnel_schlick(Color f0, float cos_v_h);
+// Compute BRDF from Cook-Torrance model
+Color cook_torrance(Vector n, Vector lt, Vector v, Color color, Color f0, float a2, float k, float metallic);
 
 /**
  * @brief Cook-Torrance model with importance sampling for specular reflection.
+ *
+ * `num_samples` rays sample the reflection. With a nonzero
+ * `RenderSettings::sample_tolerance`, that is only a cap: smooth surfaces
+ * and faint reflections get fewer (see `sample_count()`), and when the
+ * rays are traced right away, sampling also stops at the first power of
+ * two where the estimate is within the tolerance.
  */
 class PBRMaterial : public Material {
 private:
@@ -16,11 +40,147 @@ private:
     // https://google.github.io/filament/Filament.md.html#materialsystem/parameterization/remapping/reflectanceremapping
     // Usually [0, 1], but can be higher
     float reflectance;
-    int num_samples;
+    int num_samples; // hard cap
+
+    static constexpr int kMinSamples = 4; // fewest samples taken
+    // Fewest samples to check for convergence; fewer can all miss a small
+    // bright spot, or all fall below the surface
+    static constexpr int kMinChecked = 16;
+
+    /**
+     * @brief Number of samples for a point seen at `cos_v` from the normal:
+     * `num_samples` scaled down by how narrow the specular lobe is and by
+     * how weak the Fresnel term is, rounded up to a power of two.
+     */
+    int sample_count(Color const& f0, float cos_v) const;
 
 public:
     PBRMaterial(Color color, float roughness, float metallic, float reflectance = 0.5f, int num_samples = 64);
     Color get_color(
         Vector const& incoming, Point const& point, Vector const& normal,
-        Scene const* scene, int recursion_depth) const override;
+        SceneBase const* scene, int recursion_depth, float weight) const override;
+    Color albedo() const override;
+
+    // `get_color()` for any scene type `SceneT`
+    template <typename SceneT>
+    Color shade(
+        Vector const& incoming, Point const& point, Vector const& normal,
+        SceneT const& scene, int recursion_depth, float weight) const;
 };
+
+// Template definition; must be put or otherwise included in the header
+
+template <typename SceneT>
+inline Color PBRMaterial::shade(
+    Vector const& incoming, Point const& point, Vector const& normal,
+    SceneT const& scene, int recursion_depth, float weight) const {
+    // Make sure the normal points in opposite direction from the incoming ray
+    Vector n = (normal * incoming > 0) ? -normal : normal;
+
+    // ambient light
+    Color l_ambient = this->color * scene.get_ambient();
+    Color color = l_ambient; // tracks the total color
+
+    // Should really be cached in the constructor
+    float base_reflectance = 0.16f * this->reflectance * this->reflectance;
+    Color f0 = (1 - this->metallic) * base_reflectance * Color::white() + this->metallic * this->color;
+    float a2 = this->roughness * this->roughness;
+    float k = (this->roughness + 1) * (this->roughness + 1) / 8;
+
+    Vector v = -!incoming; // unit vector towards the incoming direction
+
+    // iterate over the light sources
+    scene.for_each_visible_light(point + 1e-4 * n, n, [&](Light const& light) {
+        Color l_in = light.get_intensity(point);
+        Vector lt = !light.get_direction(point); // unit vector towards the light source
+        Color brdf = cook_torrance(n, lt, v, this->color, f0, a2, k, this->metallic);
+        color = color + brdf * l_in * (n * lt);
+    });
+
+    if (recursion_depth > 0) {
+        // Importance sampling of specular reflection
+        // https://google.github.io/filament/Filament.md.html#annex/importancesamplingfortheibl
+        float tolerance = scene.get_settings().sample_tolerance;
+        int count = tolerance > 0 ? this->sample_count(f0, v * n) : this->num_samples;
+        // Stopping early needs the color of each sample, which isn't known
+        // yet when the rays are queued
+        bool queued = scene.queues_secondary();
+        bool adaptive = tolerance > 0 && !queued;
+        // Each bounce of each pixel gets its own scrambling of the samples
+        Sampler sampler(scene.get_settings().sampler, recursion_depth);
+        Color sum = Color::black();
+        // Luminance of `sum` when half as many samples were taken. Both
+        // halves of a power-of-two prefix are stratified on their own, so
+        // half the difference between their estimates is about the error
+        // of the whole.
+        float half_sum = 0.0f;
+        int taken = 0;
+        for (; taken < count; taken++) {
+            if (adaptive && (taken & (taken - 1)) == 0 && taken >= kMinSamples) {
+                float total = sum.luminance();
+                float error = std::abs(total - 2 * half_sum) / taken;
+                if (taken >= kMinChecked && error <= tolerance) {
+                    break;
+                }
+                half_sum = total;
+            }
+            auto [u1, u2] = sampler.get(taken);
+            STATS_ADD(pbr_samples, 1);
+            // Sample polar coordinate of the halfway vector wrt the `n` axis
+            // Probability density function (PDF) of h is NDF * (n * h)
+            // This is probably guaranteed to be valid by some property of NDF
+            // For some reason in all sources theta is called phi and vice versa
+            float theta = 2 * kPi * u2;
+            float cos_phi = std::sqrt((1 - u1) / (1 + (a2 - 1) * u1));
+            float sin_phi = std::sqrt(1 - cos_phi * cos_phi);
+
+            // Sample halfway vector in local cartesian coordinates
+            Vector h_local(std::cos(theta) * sin_phi, std::sin(theta) * sin_phi, cos_phi);
+            // Sample halfway vector in space coordinates
+            // Any unit vector that is not collinear with the normal
+            Vector tmp = std::abs(n.z) < 0.999 ? Vector(0.0, 0.0, 1.0) : Vector(1.0, 0.0, 0.0);
+            Vector tangent = !(tmp ^ n);
+            Vector bitangent = !(n ^ tangent);
+            // Technically shouldn't need to normalize
+            Vector h = !(tangent * h_local.x + bitangent * h_local.y + n * h_local.z);
+            // direction of reflected ray
+            Vector lt = !(incoming - 2.0f * (incoming >> h));
+
+            float cos_h = cos_phi;
+            float cos_l = lt * n;
+            float cos_v = v * n;
+            float cos_v_h = std::max(h * v, 0.0f);
+
+            if (cos_l <= 0.0f) {
+                continue;
+            }
+
+            // Calculate (specular BRDF * cosl / sampling PDF of lt)
+            // Redundant calculations are cancelled
+            Color fresnel = fresnel_schlick(f0, cos_v_h);
+            float geo = geometry_schlick_ggx(cos_v, k) * geometry_schlick_ggx(cos_l, k);
+            Color multiplier = fresnel * (geo * cos_v_h / (cos_v * cos_h));
+
+            // I'm too lazy to play with recursion_depth so just don't do recursion
+            // Also it'd be too slow since we are doing a lot of sampling
+            // Samples are never pruned: each has a tiny weight, but together
+            // they estimate the whole reflection
+            Ray ray(point + 1e-4 * n, lt);
+            if (queued) {
+                // The factor multiplies the radiance once it is known, so
+                // rounding differs slightly from the recursive estimate
+                STATS_ADD(reflection_rays, 1);
+                color = color + scene.trace_secondary(ray, 0, multiplier * (1.0f / count), weight);
+            } else if (adaptive) {
+                sum = sum + multiplier * scene.sample_radiance(ray, n, weight);
+            } else {
+                color = color + multiplier * scene.sample_radiance(ray, n, weight) * (1.0f / count);
+            }
+        }
+        if (adaptive) {
+            color = color + sum * (1.0f / taken);
+        }
+    }
+
+    return color;
+}
@@ -1,20 +1,12 @@
 #include <cmath>
-#include <optional>
 
 #include "transparent.hpp"
+#include "../scene.hpp"
 
 TransparentMaterial::TransparentMaterial(float ior)
     : ior(ior) {
 }
 
-/**
- * @brief Compute the direction of refraction.
- * @param incoming The unit incoming ray.
- * @param normal The unit normal ray pointing towards the incoming ray.
- * @param eta IOR of old medium / IOR of new medium
- * @return The unit vector in the refracted direction according to Snell's law,
- * or empty if total internal refraction occurs
- */
 std::optional<Vector> refract(Vector incoming, Vector normal, float eta) {
     // cos (theta_i) where theta_i is the angle of incoming ray
     float cosi = -(incoming * normal);
@@ -33,39 +25,6 @@ std::optional<Vector> refract(Vector incoming, Vector normal, float eta) {
 
 Color TransparentMaterial::get_color(
     Vector const& incoming, Point const& point, Vector const& normal,
-    Scene const* scene, int recursion_depth) const {
-    if (recursion_depth <= 0) {
-        return Color::black();
-    }
-
-    float eta = 1.0f / this->ior; // IOR of incoming / IOR of transmitted
-    Vector n = normal; // unit normal pointing towards the incoming ray
-    if (incoming * normal > 0.0f) {
-        // The ray comes from inside
-        eta = this->ior;
-        n = -normal;
-    }
-
-    // Compute direction and color of reflection
-    Vector reflected = incoming - 2.0f * (incoming >> n);
-    Color l_reflected = scene->trace(Ray(point + 1e-4 * n, reflected), recursion_depth - 1);
-    // Compute direction of refraction
-    std::optional<Vector> refracted = refract(!incoming, n, eta);
-    // Check total internal reflection
-    if (!refracted) {
-        return l_reflected;
-    }
-    // Compute color of refraction
-    Color l_refracted = scene->trace(Ray(point - 1e-4 * n, refracted.value()), recursion_depth - 1);
-
-    // Fresnel equations for computing the ratio of light reflected
-    float cosi = -(!incoming) * n;
-    float cost = -(refracted.value() * n);
-    // I'm not sure which one is R_s and which one is R_p, but
-    // but it doesn't matter anyways
-    float r_s = (eta * cosi - cost) / (eta * cosi + cost);
-    float r_p = (eta * cost - cosi) / (eta * cost + cosi);
-    float kr = (r_s * r_s + r_p * r_p) / 2.0f; // reflection ratio
-
-    return kr * l_reflected + (1 - kr) * l_refracted;
+    SceneBase const* scene, int recursion_depth, float weight) const {
+    return this->shade(incoming, point, normal, *scene, recursion_depth, weight);
 }
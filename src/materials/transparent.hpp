@@ -1,6 +1,19 @@
 #pragma once
 
+#include <optional>
+
 #include "../material.hpp"
+#include "../stats.hpp"
+
+/**
+ * @brief Compute the direction of refraction.
+ * @param incoming The unit incoming ray.
+ * @param normal The unit normal ray pointing towards the incoming ray.
+ * @param eta IOR of old medium / IOR of new medium
+ * @return The unit vector in the refracted direction according to Snell's law,
+ * or empty if total internal refraction occurs
+ */
+std::optional<Vector> refract(Vector incoming, Vector normal, float eta);
 
 /**
  * @brief Completely transparent material that can only reflect or refract.
@@ -14,5 +27,66 @@ public:
     TransparentMaterial(float ior);
     Color get_color(
         Vector const& incoming, Point const& point, Vector const& normal,
-        Scene const* scene, int recursion_depth) const override;
+        SceneBase const* scene, int recursion_depth, float weight) const override;
+
+    // `get_color()` for any scene type `SceneT`
+    template <typename SceneT>
+    Color shade(
+        Vector const& incoming, Point const& point, Vector const& normal,
+        SceneT const& scene, int recursion_depth, float weight) const;
 };
+
+// Template definition; must be put or otherwise included in the header
+
+template <typename SceneT>
+inline Color TransparentMaterial::shade(
+    Vector const& incoming, Point const& point, Vector const& normal,
+    SceneT const& scene, int recursion_depth, float weight) const {
+    if (recursion_depth <= 0) {
+        return Color::black();
+    }
+
+    float eta = 1.0f / this->ior; // IOR of incoming / IOR of transmitted
+    Vector n = normal; // unit normal pointing towards the incoming ray
+    if (incoming * normal > 0.0f) {
+        // The ray comes from inside
+        eta = this->ior;
+        n = -normal;
+    }
+
+    // Compute directions of reflection and refraction
+    Vector reflected = incoming - 2.0f * (incoming >> n);
+    std::optional<Vector> refracted = refract(!incoming, n, eta);
+
+    // Fresnel equations for computing the ratio of light reflected; all
+    // of it is in case of total internal reflection
+    float kr = 1.0f;
+    if (refracted) {
+        float cosi = -(!incoming) * n;
+        float cost = -(refracted.value() * n);
+        // I'm not sure which one is R_s and which one is R_p, but
+        // but it doesn't matter anyways
+        float r_s = (eta * cosi - cost) / (eta * cosi + cost);
+        float r_p = (eta * cost - cosi) / (eta * cost + cosi);
+        kr = (r_s * r_s + r_p * r_p) / 2.0f;
+    }
+
+    // Trace each branch unless it contributes too little (see
+    // `SceneBase::path_scale()`); this is what keeps the tree of rays
+    // through glass from doubling at every hit
+    Color color = Color::black();
+    if (float scale = scene.path_scale(weight * kr, recursion_depth); scale > 0) {
+        STATS_ADD(reflection_rays, 1);
+        color = color + scene.trace_secondary(Ray(point + 1e-4 * n, reflected), recursion_depth - 1,
+            kr * scale, weight * kr * scale);
+    }
+    if (!refracted) {
+        return color;
+    }
+    if (float scale = scene.path_scale(weight * (1 - kr), recursion_depth); scale > 0) {
+        STATS_ADD(refraction_rays, 1);
+        color = color + scene.trace_secondary(Ray(point - 1e-4 * n, refracted.value()), recursion_depth - 1,
+            (1 - kr) * scale, weight * (1 - kr) * scale);
+    }
+    return color;
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#ifdef __SSE__
+#include <immintrin.h>
+#endif
+
+#include "ray.hpp"
+#include "vector.hpp"
+
+class Shape;
+
+// Number of rays traced together: one per lane of the widest float
+// register enabled at build time (AVX with `-march=native`, SSE otherwise)
+#ifdef __AVX__
+constexpr int kPacketSize = 8;
+#else
+constexpr int kPacketSize = 4;
+#endif
+
+// GCC vector extensions: arithmetic and comparisons act lane-wise and
+// compile to SSE/AVX instructions. Comparisons give masks, with lanes set
+// to -1 (all bits) where true and 0 where false.
+typedef float PacketFloat __attribute__((vector_size(kPacketSize * sizeof(float))));
+typedef int PacketMask __attribute__((vector_size(kPacketSize * sizeof(int))));
+
+inline PacketFloat packet_sqrt(PacketFloat x) {
+#if defined(__AVX__)
+    return (PacketFloat)_mm256_sqrt_ps((__m256)x);
+#elif defined(__SSE__)
+    return (PacketFloat)_mm_sqrt_ps((__m128)x);
+#else
+    for (int k = 0; k < kPacketSize; k++) {
+        x[k] = std::sqrt(x[k]);
+    }
+    return x;
+#endif
+}
+
+inline PacketFloat packet_broadcast(float x) {
+    PacketFloat zero {};
+    return zero + x;
+}
+
+// Load `kPacketSize` consecutive floats, with no alignment requirement
+inline PacketFloat packet_load(float const* data) {
+    PacketFloat x;
+    std::memcpy(&x, data, sizeof(x));
+    return x;
+}
+
+// Mask of the first `n` lanes
+inline PacketMask packet_first_lanes(int n) {
+    PacketMask lanes;
+    for (int k = 0; k < kPacketSize; k++) {
+        lanes[k] = k;
+    }
+    return lanes < n;
+}
+
+// Same results as `std::min()` and `std::max()` in every lane, NaNs included
+inline PacketFloat packet_min(PacketFloat a, PacketFloat b) {
+    return b < a ? b : a;
+}
+
+inline PacketFloat packet_max(PacketFloat a, PacketFloat b) {
+    return a < b ? b : a;
+}
+
+/**
+ * @brief `e^x` in every lane, to a relative error of a few millionths,
+ * for weights and falloffs rather than exact math. Meant for `x <= 0`:
+ * below about -87 (including -infinity) it gives the smallest normal
+ * float; NaNs aren't handled.
+ */
+inline PacketFloat packet_exp(PacketFloat x) {
+    // e^x = 2^i * 2^f with i an integer and f in [0, 1)
+    PacketFloat y = packet_max(x, packet_broadcast(-87.0f)) * 1.44269504f; // log2(e)
+    PacketMask i = __builtin_convertvector(y, PacketMask); // rounded towards zero
+    i += (PacketMask)(__builtin_convertvector(i, PacketFloat) > y); // -1 where rounded up
+    PacketFloat f = y - __builtin_convertvector(i, PacketFloat);
+    // Minimax polynomial of 2^f on [0, 1)
+    PacketFloat p = packet_broadcast(1.8775767e-3f);
+    p = p * f + 8.9893397e-3f;
+    p = p * f + 5.5826318e-2f;
+    p = p * f + 2.4015361e-1f;
+    p = p * f + 6.9315308e-1f;
+    p = p * f + 9.9999994e-1f;
+    // 2^i, built from its exponent bits
+    return p * (PacketFloat)((i + 127) << 23);
+}
+
+inline bool packet_any(PacketMask mask) {
+    for (int k = 0; k < kPacketSize; k++) {
+        if (mask[k]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief `kPacketSize` vectors stored by component. The operators are the
+ * lane-wise versions of those of `Vector` (`*` is the dot product, `^` the
+ * cross product, `~` the magnitude and `!` normalization).
+ */
+struct PacketVector {
+    PacketFloat x, y, z;
+};
+
+inline PacketVector packet_broadcast(Vector const& vec) {
+    return PacketVector { packet_broadcast(vec.x), packet_broadcast(vec.y), packet_broadcast(vec.z) };
+}
+
+// Points go through the same lane-wise arithmetic, as their coordinates
+inline PacketVector packet_broadcast(Point const& point) {
+    return PacketVector { packet_broadcast(point.x), packet_broadcast(point.y), packet_broadcast(point.z) };
+}
+
+inline PacketVector operator+(PacketVector const& lhs, PacketVector const& rhs) {
+    return PacketVector { lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z };
+}
+
+inline PacketVector operator-(PacketVector const& lhs, PacketVector const& rhs) {
+    return PacketVector { lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z };
+}
+
+inline PacketVector operator-(PacketVector const& vec) {
+    return PacketVector { -vec.x, -vec.y, -vec.z };
+}
+
+inline PacketVector operator*(PacketVector const& vec, PacketFloat scalar) {
+    return PacketVector { vec.x * scalar, vec.y * scalar, vec.z * scalar };
+}
+
+inline PacketVector operator*(PacketFloat scalar, PacketVector const& vec) {
+    return vec * scalar;
+}
+
+inline PacketVector operator/(PacketVector const& vec, PacketFloat scalar) {
+    return PacketVector { vec.x / scalar, vec.y / scalar, vec.z / scalar };
+}
+
+inline PacketFloat operator*(PacketVector const& lhs, PacketVector const& rhs) {
+    return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
+}
+
+inline PacketVector operator^(PacketVector const& lhs, PacketVector const& rhs) {
+    return PacketVector {
+        lhs.y * rhs.z - lhs.z * rhs.y,
+        lhs.z * rhs.x - lhs.x * rhs.z,
+        lhs.x * rhs.y - lhs.y * rhs.x
+    };
+}
+
+inline PacketFloat operator~(PacketVector const& vec) {
+    return packet_sqrt(vec * vec);
+}
+
+inline PacketVector operator!(PacketVector const& vec) {
+    return vec / ~vec;
+}
+
+/**
+ * @brief Vectors stored by component (structure of arrays), so that
+ * `kPacketSize` of them at a time can be loaded into a `PacketVector`.
+ * Every array has `kPacketSize` entries of padding past the last vector,
+ * so that loads near the end stay in bounds; the padding is zero.
+ */
+struct VectorArrays {
+    std::vector<float> x, y, z;
+    int count = 0;
+
+    void push_back(Vector const& vec);
+    void push_back(Point const& point); // stored as its coordinates
+    Vector operator[](int i) const;
+
+    // Vectors `i` to `i + kPacketSize - 1`; `i` may be up to `count - 1`
+    PacketVector load(int i) const;
+    // Store the first `lanes` lanes of `vec` into vectors `i` onwards
+    void store(int i, PacketVector const& vec, int lanes = kPacketSize);
+};
+
+// Batch versions of the operators of `Vector`, over every vector of the
+// arrays, `kPacketSize` at a time; `a` and `b` must have the same count
+
+// `out[i] = a[i] * b[i]`, where `out` has room for `a.count + kPacketSize` floats
+void batch_dot(VectorArrays const& a, VectorArrays const& b, float* out);
+// `out[i] = a[i] ^ b[i]`, growing `out` to `a.count` vectors if needed
+void batch_cross(VectorArrays const& a, VectorArrays const& b, VectorArrays& out);
+// `a[i] = !a[i]`
+void batch_normalize(VectorArrays& a);
+
+/**
+ * @brief `kPacketSize` rays stored by component, so that one instruction
+ * processes the same component of every ray. Lanes that are not set in
+ * `active` (e.g., past the edge of the image) are ignored by every test.
+ */
+struct RayPacket {
+    PacketFloat ox, oy, oz; // origins
+    PacketFloat dx, dy, dz; // directions
+    PacketMask active;
+
+    RayPacket(); // every lane inactive
+
+    void set(int lane, Ray const& ray); // store `ray` in `lane` and activate it
+    Ray ray(int lane) const;
+    PacketVector origin() const;
+    PacketVector direction() const;
+};
+
+/**
+ * @brief Closest intersection found so far for each lane of a packet.
+ */
+struct PacketHit {
+    PacketFloat t; // infinity where nothing has been hit
+    Shape const* shape[kPacketSize]; // null where nothing has been hit
+
+    PacketHit();
+};
+
+inline RayPacket::RayPacket()
+    : ox {}, oy {}, oz {}, dx {}, dy {}, dz {}, active {} {
+    // Inactive lanes get a harmless direction so that no NaNs show up
+    for (int k = 0; k < kPacketSize; k++) {
+        this->dz[k] = 1.0f;
+    }
+}
+
+inline void RayPacket::set(int lane, Ray const& ray) {
+    this->ox[lane] = ray.origin.x;
+    this->oy[lane] = ray.origin.y;
+    this->oz[lane] = ray.origin.z;
+    this->dx[lane] = ray.direction.x;
+    this->dy[lane] = ray.direction.y;
+    this->dz[lane] = ray.direction.z;
+    this->active[lane] = -1;
+}
+
+inline Ray RayPacket::ray(int lane) const {
+    return Ray(Point(this->ox[lane], this->oy[lane], this->oz[lane]),
+        Vector(this->dx[lane], this->dy[lane], this->dz[lane]));
+}
+
+inline PacketVector RayPacket::origin() const {
+    return PacketVector { this->ox, this->oy, this->oz };
+}
+
+inline PacketVector RayPacket::direction() const {
+    return PacketVector { this->dx, this->dy, this->dz };
+}
+
+inline void VectorArrays::push_back(Vector const& vec) {
+    for (std::vector<float>* array : { &this->x, &this->y, &this->z }) {
+        array->resize(this->count + 1 + kPacketSize, 0.0f);
+    }
+    this->x[this->count] = vec.x;
+    this->y[this->count] = vec.y;
+    this->z[this->count] = vec.z;
+    this->count++;
+}
+
+inline void VectorArrays::push_back(Point const& point) {
+    this->push_back(Vector(point.x, point.y, point.z));
+}
+
+inline Vector VectorArrays::operator[](int i) const {
+    return Vector(this->x[i], this->y[i], this->z[i]);
+}
+
+inline PacketVector VectorArrays::load(int i) const {
+    return PacketVector { packet_load(&this->x[i]), packet_load(&this->y[i]), packet_load(&this->z[i]) };
+}
+
+inline void VectorArrays::store(int i, PacketVector const& vec, int lanes) {
+    for (int k = 0; k < lanes; k++) {
+        this->x[i + k] = vec.x[k];
+        this->y[i + k] = vec.y[k];
+        this->z[i + k] = vec.z[k];
+    }
+}
+
+inline void batch_dot(VectorArrays const& a, VectorArrays const& b, float* out) {
+    for (int i = 0; i < a.count; i += kPacketSize) {
+        PacketFloat dot = a.load(i) * b.load(i);
+        std::memcpy(&out[i], &dot, sizeof(dot));
+    }
+}
+
+inline void batch_cross(VectorArrays const& a, VectorArrays const& b, VectorArrays& out) {
+    while (out.count < a.count) {
+        out.push_back(Vector(0.0f, 0.0f, 0.0f));
+    }
+    for (int i = 0; i < a.count; i += kPacketSize) {
+        out.store(i, a.load(i) ^ b.load(i), std::min(kPacketSize, a.count - i));
+    }
+}
+
+inline void batch_normalize(VectorArrays& a) {
+    for (int i = 0; i < a.count; i += kPacketSize) {
+        // Padding lanes are zero, so they are left out of the division
+        a.store(i, !a.load(i), std::min(kPacketSize, a.count - i));
+    }
+}
+
+inline PacketHit::PacketHit()
+    : shape {} {
+    for (int k = 0; k < kPacketSize; k++) {
+        this->t[k] = std::numeric_limits<float>::infinity();
+    }
+}
@@ -0,0 +1,200 @@
+#include "primitives.hpp"
+#include "shapes/plane.hpp"
+#include "shapes/sphere.hpp"
+#include "stats.hpp"
+
+// Append to a padded array holding `count` values (see `PrimitiveStore`)
+void append_padded(std::vector<float>& array, int count, float value) {
+    array.resize(count + 1 + kPacketSize, 0.0f);
+    array[count] = value;
+}
+
+void PrimitiveStore::add(Shape const* shape) {
+    if (shape->primitive_kind() == PrimitiveKind::Sphere) {
+        Sphere const& sphere = static_cast<Sphere const&>(*shape);
+        int count = this->sphere_count();
+        this->sphere_centers.push_back(sphere.get_center());
+        append_padded(this->sphere_radius2, count, sphere.get_radius() * sphere.get_radius());
+        this->sphere_shapes.push_back(shape);
+        this->dirty = true;
+    } else if (shape->primitive_kind() == PrimitiveKind::Plane) {
+        Plane const& plane = static_cast<Plane const&>(*shape);
+        this->plane_points.push_back(plane.get_point());
+        this->plane_normals.push_back(plane.get_normal());
+        this->plane_shapes.push_back(shape);
+    }
+}
+
+void PrimitiveStore::build() {
+    if (!this->dirty) {
+        return;
+    }
+    std::vector<AABB> bounds;
+    bounds.reserve(this->sphere_count());
+    for (Shape const* shape : this->sphere_shapes) {
+        bounds.push_back(shape->bounds().value());
+    }
+    this->bvh.build(bounds);
+
+    // Lay out the spheres in leaf order, so that each leaf is a range
+    std::vector<int> const& order = this->bvh.leaf_order();
+    auto reorder = [&](auto& array) {
+        auto copy = array;
+        for (std::size_t i = 0; i < order.size(); i++) {
+            array[i] = copy[order[i]];
+        }
+    };
+    reorder(this->sphere_centers.x);
+    reorder(this->sphere_centers.y);
+    reorder(this->sphere_centers.z);
+    reorder(this->sphere_radius2);
+    reorder(this->sphere_shapes);
+    this->dirty = false;
+}
+
+int PrimitiveStore::sphere_count() const {
+    return this->sphere_shapes.size();
+}
+
+int PrimitiveStore::plane_count() const {
+    return this->plane_shapes.size();
+}
+
+Shape const* PrimitiveStore::intersect_spheres(Ray const& ray, int first, int count, float& t_min) const {
+    STATS_ADD(intersection_tests, count);
+    PacketVector origin = packet_broadcast(ray.origin);
+    PacketVector d = packet_broadcast(ray.direction);
+    Shape const* closest = nullptr;
+    for (int i = first; i < first + count; i += kPacketSize) {
+        PacketVector o = origin - this->sphere_centers.load(i);
+        PacketFloat t {};
+        PacketMask hits = packet_first_lanes(first + count - i)
+            & sphere_hits(o, d, packet_load(&this->sphere_radius2[i]), t);
+        if (!packet_any(hits)) {
+            continue;
+        }
+        // Lanes in order, so that ties go to the first sphere
+        for (int k = 0; k < kPacketSize; k++) {
+            if (hits[k] && t[k] < t_min) {
+                t_min = t[k];
+                closest = this->sphere_shapes[i + k];
+            }
+        }
+    }
+    return closest;
+}
+
+bool PrimitiveStore::occluded_spheres(Ray const& ray, int first, int count, float t_max) const {
+    STATS_ADD(intersection_tests, count);
+    PacketVector origin = packet_broadcast(ray.origin);
+    PacketVector d = packet_broadcast(ray.direction);
+    for (int i = first; i < first + count; i += kPacketSize) {
+        PacketVector o = origin - this->sphere_centers.load(i);
+        PacketMask blocks = packet_first_lanes(first + count - i)
+            & sphere_blocks(o, d, packet_load(&this->sphere_radius2[i]), packet_broadcast(t_max));
+        if (packet_any(blocks)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PrimitiveStore::intersect_spheres(RayPacket const& packet, int first, int count, PacketHit& hit) const {
+    STATS_ADD(intersection_tests, count * kPacketSize);
+    PacketVector d = packet.direction();
+    for (int i = first; i < first + count; i++) {
+        PacketVector o = packet.origin() - packet_broadcast(this->sphere_centers[i]);
+        PacketFloat t {};
+        PacketMask hits = packet.active & sphere_hits(o, d, packet_broadcast(this->sphere_radius2[i]), t);
+        hits &= t < hit.t;
+        if (!packet_any(hits)) {
+            continue;
+        }
+        hit.t = hits ? t : hit.t;
+        for (int k = 0; k < kPacketSize; k++) {
+            if (hits[k]) {
+                hit.shape[k] = this->sphere_shapes[i];
+            }
+        }
+    }
+}
+
+Shape const* PrimitiveStore::intersect(Ray const& ray, float& t_min) const {
+    Shape const* closest = nullptr;
+    auto visit = [&](int first, int count) {
+        if (Shape const* shape = this->intersect_spheres(ray, first, count, t_min)) {
+            closest = shape;
+        }
+        return false; // keep looking for closer intersections
+    };
+    if (this->dirty) {
+        visit(0, this->sphere_count());
+    } else {
+        this->bvh.traverse_leaves(ray, t_min, visit);
+    }
+
+    STATS_ADD(intersection_tests, this->plane_count());
+    PacketVector origin = packet_broadcast(ray.origin);
+    PacketVector d = packet_broadcast(ray.direction);
+    for (int i = 0; i < this->plane_count(); i += kPacketSize) {
+        PacketVector p = this->plane_points.load(i) - origin;
+        PacketFloat t {};
+        PacketMask hits = packet_first_lanes(this->plane_count() - i) & plane_hits(p, d, this->plane_normals.load(i), t);
+        for (int k = 0; k < kPacketSize; k++) {
+            if (hits[k] && t[k] < t_min) {
+                t_min = t[k];
+                closest = this->plane_shapes[i + k];
+            }
+        }
+    }
+    return closest;
+}
+
+bool PrimitiveStore::occluded(Ray const& ray, float t_max) const {
+    // Planes are few and large, so test them first
+    STATS_ADD(intersection_tests, this->plane_count());
+    PacketVector origin = packet_broadcast(ray.origin);
+    PacketVector d = packet_broadcast(ray.direction);
+    for (int i = 0; i < this->plane_count(); i += kPacketSize) {
+        PacketVector p = this->plane_points.load(i) - origin;
+        PacketFloat t {};
+        PacketMask hits = packet_first_lanes(this->plane_count() - i) & plane_hits(p, d, this->plane_normals.load(i), t);
+        if (packet_any(hits & (t < t_max))) {
+            return true;
+        }
+    }
+
+    auto visit = [&](int first, int count) {
+        return this->occluded_spheres(ray, first, count, t_max);
+    };
+    if (this->dirty) {
+        return visit(0, this->sphere_count());
+    }
+    float t_limit = t_max;
+    return this->bvh.traverse_leaves(ray, t_limit, visit);
+}
+
+void PrimitiveStore::intersect(RayPacket const& packet, PacketHit& hit) const {
+    auto visit = [&](int first, int count) {
+        this->intersect_spheres(packet, first, count, hit);
+    };
+    if (this->dirty) {
+        visit(0, this->sphere_count());
+    } else {
+        this->bvh.traverse_packet_leaves(packet, hit.t, visit);
+    }
+
+    STATS_ADD(intersection_tests, this->plane_count() * kPacketSize);
+    PacketVector d = packet.direction();
+    for (int i = 0; i < this->plane_count(); i++) {
+        PacketVector p = packet_broadcast(this->plane_points[i]) - packet.origin();
+        PacketFloat t {};
+        PacketMask hits = packet.active & plane_hits(p, d, packet_broadcast(this->plane_normals[i]), t) & (t < hit.t);
+        hit.t = hits ? t : hit.t;
+        for (int k = 0; k < kPacketSize; k++) {
+            if (hits[k]) {
+                hit.shape[k] = this->plane_shapes[i];
+            }
+        }
+    }
+}
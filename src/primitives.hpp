@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+
+#include "bvh.hpp"
+#include "packet.hpp"
+#include "ray.hpp"
+
+class Shape;
+
+/**
+ * @brief Geometry of the scene's spheres and planes, stored as one array
+ * per component (structure of arrays) so that a ray is tested against
+ * `kPacketSize` primitives at a time, without virtual calls.
+ *
+ * Only geometry is copied: every primitive keeps a pointer to the shape it
+ * came from, which is still used for normals and materials once a hit is
+ * found. Spheres are indexed by a BVH whose leaves are contiguous in the
+ * arrays; planes are unbounded and tested against every ray.
+ */
+class PrimitiveStore {
+private:
+    // Every array has `kPacketSize` entries of padding past the last
+    // primitive, so that SIMD loads near the end stay in bounds
+    VectorArrays sphere_centers;
+    std::vector<float> sphere_radius2; // squared radii
+    std::vector<Shape const*> sphere_shapes;
+    VectorArrays plane_points; // a point on each plane
+    VectorArrays plane_normals; // unit normals
+    std::vector<Shape const*> plane_shapes;
+
+    BVH bvh;
+    bool dirty = false; // spheres were added since the last `build()`
+
+    // Intersect spheres `first` to `first + count - 1` with one ray
+    Shape const* intersect_spheres(Ray const& ray, int first, int count, float& t_min) const;
+    bool occluded_spheres(Ray const& ray, int first, int count, float t_max) const;
+    void intersect_spheres(RayPacket const& packet, int first, int count, PacketHit& hit) const;
+
+public:
+    PrimitiveStore() = default;
+
+    /**
+     * @brief Copy the geometry of a shape whose `primitive_kind()` is
+     * not `PrimitiveKind::Custom`. The shape must outlive the store.
+     */
+    void add(Shape const* shape);
+
+    /**
+     * @brief Build the sphere BVH and reorder the spheres to match its
+     * leaves. Does nothing if no sphere was added since the last call.
+     * Queries before that fall back to testing every sphere.
+     */
+    void build();
+
+    int sphere_count() const;
+    int plane_count() const;
+
+    /**
+     * @brief Find the closest primitive hit by the ray before `t_min`.
+     * @return The shape hit, with its parameter stored in `t_min`, or
+     * null (and `t_min` unchanged) if nothing is hit before `t_min`.
+     */
+    Shape const* intersect(Ray const& ray, float& t_min) const;
+
+    // Whether any primitive is hit by the ray at some `t` in `(0, t_max)`
+    bool occluded(Ray const& ray, float t_max) const;
+
+    // Packet version of `intersect()`; lanes only change where closer than `hit.t`
+    void intersect(RayPacket const& packet, PacketHit& hit) const;
+};
+
+// Lane-wise intersection tests, used by both the store (one ray against
+// several primitives) and the shapes' `intersect_packet()` (several rays
+// against one primitive); same arithmetic as the scalar versions
+
+/**
+ * @brief Lane-wise `Sphere::intersect_first()`.
+ * @param o Ray origins minus sphere centers
+ * @param d Ray directions
+ * @param radius2 Squared radii
+ * @param t Set to the intersection parameter in lanes that hit
+ * @return Mask of the lanes hitting a sphere at a positive parameter
+ */
+inline PacketMask sphere_hits(PacketVector const& o, PacketVector const& d, PacketFloat radius2, PacketFloat& t) {
+    PacketFloat a = d * d;
+    PacketFloat b = 2 * (d * o);
+    PacketFloat c = o * o - radius2;
+    PacketFloat discriminant = b * b - 4 * a * c;
+    PacketMask hits = discriminant >= 0;
+    if (!packet_any(hits)) {
+        return hits;
+    }
+    PacketFloat root = packet_sqrt(discriminant); // NaN where negative, but masked out
+    PacketFloat t1 = (-b - root) / (2 * a);
+    PacketFloat t2 = (-b + root) / (2 * a);
+    t = t1 > 0 ? t1 : t2;
+    return hits & (t > 0);
+}
+
+/**
+ * @brief Lane-wise `Sphere::intersects_any()`; arguments as in `sphere_hits()`.
+ */
+inline PacketMask sphere_blocks(PacketVector const& o, PacketVector const& d, PacketFloat radius2, PacketFloat t_max) {
+    PacketFloat a = d * d;
+    PacketFloat half_b = d * o;
+    PacketFloat c = o * o - radius2;
+    PacketFloat discriminant = half_b * half_b - a * c;
+    PacketMask hits = discriminant >= 0;
+    if (!packet_any(hits)) {
+        return hits;
+    }
+    PacketFloat root = packet_sqrt(discriminant);
+    PacketFloat at1 = -half_b - root;
+    PacketFloat at2 = -half_b + root;
+    PacketFloat at_max = a * t_max;
+    return hits & (((at1 > 0) & (at1 < at_max)) | ((at2 > 0) & (at2 < at_max)));
+}
+
+/**
+ * @brief Lane-wise `Plane::intersect_first()`.
+ * @param p Points on the planes minus ray origins
+ * @param d Ray directions
+ * @param n Unit normals of the planes
+ * @param t Set to the intersection parameter in lanes that hit
+ * @return Mask of the lanes hitting a plane at a positive parameter
+ */
+inline PacketMask plane_hits(PacketVector const& p, PacketVector const& d, PacketVector const& n, PacketFloat& t) {
+    PacketFloat div = d * n;
+    t = (p * n) / div;
+    return ((div >= 1e-6f) | (div <= -1e-6f)) & (t > 0);
+}
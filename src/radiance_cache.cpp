@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cmath>
+
+#include "radiance_cache.hpp"
+
+bool operator==(RadianceCacheSettings const& lhs, RadianceCacheSettings const& rhs) {
+    return lhs.enabled == rhs.enabled && lhs.cell_size == rhs.cell_size
+        && lhs.direction_bins == rhs.direction_bins && lhs.samples_per_entry == rhs.samples_per_entry
+        && lhs.capacity == rhs.capacity;
+}
+
+bool operator!=(RadianceCacheSettings const& lhs, RadianceCacheSettings const& rhs) {
+    return !(lhs == rhs);
+}
+
+// SplitMix64 finalizer, to spread the bins over the whole table
+// https://prng.di.unimi.it/splitmix64.c
+uint64_t mix_bits(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+void RadianceCache::configure(RadianceCacheSettings const& settings) {
+    if (settings == this->settings) {
+        return;
+    }
+    this->settings = settings;
+    this->entries.clear();
+    if (settings.enabled) {
+        std::size_t sets = std::max<std::size_t>(1, settings.capacity / kWays);
+        this->entries.assign(sets * kWays, Entry());
+    }
+}
+
+void RadianceCache::clear() {
+    std::fill(this->entries.begin(), this->entries.end(), Entry());
+}
+
+void RadianceCache::next_frame() {
+    this->frame++;
+}
+
+uint32_t RadianceCache::direction_bin(Vector const& direction) const {
+    // Project onto the octahedron |x| + |y| + |z| = 1, then unfold its
+    // lower half over the upper one to get a square
+    float l1 = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    float u = direction.x / l1;
+    float v = direction.y / l1;
+    if (direction.z < 0) {
+        float fu = (1 - std::abs(v)) * (u < 0 ? -1 : 1);
+        float fv = (1 - std::abs(u)) * (v < 0 ? -1 : 1);
+        u = fu;
+        v = fv;
+    }
+    int bins = this->settings.direction_bins;
+    auto bin = [&](float x) { return std::clamp((int)((x + 1) / 2 * bins), 0, bins - 1); };
+    return bin(u) * bins + bin(v);
+}
+
+uint64_t RadianceCache::key(Point const& point, Vector const& normal, Vector const& direction) const {
+    auto cell = [&](float x) { return (uint64_t)(int64_t)std::floor(x / this->settings.cell_size); };
+    uint64_t key = mix_bits(cell(point.x));
+    key = mix_bits(key ^ cell(point.y));
+    key = mix_bits(key ^ cell(point.z));
+    key = mix_bits(key ^ this->direction_bin(normal));
+    key = mix_bits(key ^ this->direction_bin(direction));
+    return std::max<uint64_t>(key, 1); // 0 marks empty entries
+}
+
+std::size_t RadianceCache::set_of(uint64_t key) const {
+    return (key >> 16) % (this->entries.size() / kWays) * kWays;
+}
+
+std::optional<Color> RadianceCache::find(uint64_t key) {
+    if (this->entries.empty()) {
+        return std::nullopt;
+    }
+    std::size_t set = this->set_of(key);
+    std::lock_guard<std::mutex> lock(this->locks[set / kWays % kLocks]);
+    for (std::size_t way = set; way < set + kWays; way++) {
+        Entry& entry = this->entries[way];
+        if (entry.key == key) {
+            entry.last_used = this->frame;
+            if ((int)entry.count < this->settings.samples_per_entry) {
+                return std::nullopt;
+            }
+            return entry.sum * (1.0f / entry.count);
+        }
+    }
+    return std::nullopt;
+}
+
+void RadianceCache::add(uint64_t key, Color const& radiance) {
+    if (this->entries.empty()) {
+        return;
+    }
+    std::size_t set = this->set_of(key);
+    std::lock_guard<std::mutex> lock(this->locks[set / kWays % kLocks]);
+    std::size_t victim = set;
+    for (std::size_t way = set; way < set + kWays; way++) {
+        Entry& entry = this->entries[way];
+        if (entry.key == key) {
+            // Another thread may have completed the entry in the meantime
+            if ((int)entry.count < this->settings.samples_per_entry) {
+                entry.sum = entry.sum + radiance;
+                entry.count++;
+            }
+            entry.last_used = this->frame;
+            return;
+        }
+        // Empty entries have the oldest frame of all
+        if (this->entries[way].last_used < this->entries[victim].last_used) {
+            victim = way;
+        }
+    }
+    this->entries[victim] = Entry { key, radiance, 1, this->frame };
+}
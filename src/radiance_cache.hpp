@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "color.hpp"
+#include "vector.hpp"
+
+/**
+ * @brief Options of the radiance cache (see `RadianceCache`). The cell
+ * size and the number of direction bins bound the error of a reused
+ * estimate: it was traced from somewhere in the same cell, in a direction
+ * within the same bin, off a surface facing within the same bin.
+ */
+struct RadianceCacheSettings {
+    bool enabled = false;
+    float cell_size = 0.05f; // side of the grid cells positions are binned into
+    // Directions and normals are binned on an octahedral map of
+    // `direction_bins` by `direction_bins` cells
+    int direction_bins = 16;
+    int samples_per_entry = 4; // rays traced for an entry before it is reused
+    // Most entries kept, 32 bytes each; beyond that, the least recently
+    // used entry of the same set is evicted
+    std::size_t capacity = 1 << 18;
+};
+
+bool operator==(RadianceCacheSettings const& lhs, RadianceCacheSettings const& rhs);
+bool operator!=(RadianceCacheSettings const& lhs, RadianceCacheSettings const& rhs);
+
+/**
+ * @brief Estimates of the radiance arriving at points of the scene, stored
+ * in a hashed grid keyed on position, surface normal and direction bins.
+ * Used by `SceneBase::sample_radiance()` so that the importance samples of
+ * `PBRMaterial` at neighboring pixels share their rays.
+ *
+ * The entries form a set-associative table of fixed size, so memory use
+ * is bounded; a new entry replaces the least recently used one of its set.
+ * Thread-safe: each set is guarded by one of a few striped mutexes.
+ */
+class RadianceCache {
+public:
+    RadianceCache() = default;
+    RadianceCache(RadianceCache const&) = delete;
+    RadianceCache& operator=(RadianceCache const&) = delete;
+
+    // Apply the settings, dropping every entry if they changed
+    void configure(RadianceCacheSettings const& settings);
+    // Drop every entry, e.g., because the scene changed
+    void clear();
+    // Start a new frame; entries used in recent frames are evicted last
+    void next_frame();
+
+    // Key of the radiance arriving at `point`, on a surface facing `normal`,
+    // from the opposite of `direction`
+    uint64_t key(Point const& point, Vector const& normal, Vector const& direction) const;
+
+    // The estimate for `key`, if it has `samples_per_entry` samples
+    std::optional<Color> find(uint64_t key);
+
+    // Add a traced sample to the estimate for `key`
+    void add(uint64_t key, Color const& radiance);
+
+private:
+    struct Entry {
+        uint64_t key = 0; // 0 for an empty entry
+        Color sum = Color::black(); // of the samples
+        uint32_t count = 0; // of the samples
+        uint32_t last_used = 0; // frame
+    };
+    static constexpr std::size_t kWays = 4; // entries per set
+    static constexpr std::size_t kLocks = 64;
+
+    RadianceCacheSettings settings;
+    std::vector<Entry> entries; // sets of `kWays` consecutive entries
+    std::array<std::mutex, kLocks> locks;
+    uint32_t frame = 1;
+
+    std::size_t set_of(uint64_t key) const; // index of the first entry of the set
+    // Bin of a unit vector on the octahedral map
+    uint32_t direction_bin(Vector const& direction) const;
+};
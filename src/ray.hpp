@@ -11,10 +11,21 @@ public:
     Point origin;
     Vector direction;
 
-    Ray(Point, Vector);
+    constexpr Ray(Point, Vector);
 
     /**
      * @brief Compute `origin + t * direction`.
      */
-    Point at(float t) const;
+    constexpr Point at(float t) const;
 };
+
+// Used for every ray, so defined in the header to allow inlining
+
+constexpr Ray::Ray(Point origin, Vector direction)
+    : origin(origin)
+    , direction(direction) {
+}
+
+constexpr Point Ray::at(float t) const {
+    return this->origin + t * this->direction;
+}
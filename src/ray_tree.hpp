@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "color.hpp"
+#include "ray.hpp"
+#include "sampler.hpp"
+
+/**
+ * @brief The secondary rays spawned by a run of primary rays, kept in an
+ * explicit tree instead of on the call stack. Used by the iterative and
+ * wavefront integrators (see `RenderSettings::integrator`).
+ *
+ * Nodes are shaded one at a time. While a node is being shaded,
+ * `SceneBase::trace_secondary()` hands its secondary rays to `defer()`
+ * instead of tracing them, so each node's color only covers the node
+ * itself, and its children are appended to the tree. Once every node is
+ * shaded, `resolve()` folds the children back into their parents, in the
+ * same order and with the same arithmetic as the recursive tracer, so the
+ * images are identical.
+ *
+ * Once the tree holds `budget` nodes, the nodes shaded after that trace
+ * their secondary rays recursively instead, which bounds its memory.
+ */
+class RayTree {
+public:
+    struct Node {
+        Ray ray;
+        int depth; // recursion depth left
+        float weight; // contribution to the pixel
+        Color factor; // what the parent multiplies this node's color by
+        int first_child = 0; // children are contiguous
+        int child_count = 0;
+        Color color = Color::black(); // of the node alone until `resolve()`
+        uint32_t pixel; // the ray's, see `Sampler::pixel_id()`
+
+        Node(Ray const& ray, int depth, float weight, Color const& factor, uint32_t pixel);
+    };
+
+    // Tree of the calling thread while its nodes are being shaded, or null
+    inline static thread_local RayTree* active = nullptr;
+
+    std::vector<Node> nodes;
+
+    // Remove every node, and keep at most `budget` (roughly) from now on
+    void clear(std::size_t budget);
+
+    // Add a node with no parent (e.g., a primary ray); returns its index
+    int add_root(Ray const& ray, int depth, uint32_t pixel);
+
+    /**
+     * @brief Start shading node `index`: from now on, secondary rays are
+     * its children, unless the tree is full, and samples are drawn for
+     * its pixel (see `Sampler::pixel`).
+     */
+    void begin(int index);
+
+    // Whether secondary rays are added to the tree rather than traced
+    bool defers() const;
+
+    /**
+     * @brief Add a child to the current node.
+     * @return Black, so that the material's own color is left unchanged
+     */
+    Color defer(Ray const& ray, int depth, Color const& factor, float weight);
+
+    // Fold the color of every node into its parent's, deepest nodes first
+    void resolve();
+
+private:
+    std::size_t budget = 0;
+    int current = -1; // node being shaded
+    bool deferring = false; // whether the children of `current` are added
+};
+
+// Inline definitions
+
+inline RayTree::Node::Node(Ray const& ray, int depth, float weight, Color const& factor, uint32_t pixel)
+    : ray(ray)
+    , depth(depth)
+    , weight(weight)
+    , factor(factor)
+    , pixel(pixel) {
+}
+
+inline void RayTree::clear(std::size_t budget) {
+    this->nodes.clear();
+    this->budget = budget;
+    this->current = -1;
+}
+
+inline int RayTree::add_root(Ray const& ray, int depth, uint32_t pixel) {
+    this->nodes.emplace_back(ray, depth, 1.0f, Color::white(), pixel);
+    return this->nodes.size() - 1;
+}
+
+inline void RayTree::begin(int index) {
+    this->current = index;
+    Sampler::pixel = this->nodes[index].pixel;
+    // Decided once per node, so that either all its children are in the
+    // tree or none are, and their colors are still added up in order
+    this->deferring = this->nodes.size() < this->budget;
+}
+
+inline bool RayTree::defers() const {
+    return this->current >= 0 && this->deferring;
+}
+
+inline Color RayTree::defer(Ray const& ray, int depth, Color const& factor, float weight) {
+    Node& parent = this->nodes[this->current];
+    if (parent.child_count == 0) {
+        parent.first_child = this->nodes.size();
+    }
+    parent.child_count++;
+    uint32_t pixel = parent.pixel;
+    // `parent` may be invalidated from here on
+    this->nodes.emplace_back(ray, depth, weight, factor, pixel);
+    return Color::black();
+}
+
+inline void RayTree::resolve() {
+    // Children always come after their parent
+    for (int n = (int)this->nodes.size() - 1; n >= 0; n--) {
+        Node& node = this->nodes[n];
+        for (int c = node.first_child; c < node.first_child + node.child_count; c++) {
+            node.color = node.color + this->nodes[c].factor * this->nodes[c].color;
+        }
+    }
+    this->current = -1;
+}
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "sampler.hpp"
+
+constexpr int kSobolTableSize = 1024;
+constexpr int kMaskSize = 64; // side of the blue-noise mask, a power of two
+
+// Sobol point `i`, as 32-bit fixed point numbers
+// Each bit of `i` flips the bits of the direction numbers of its index:
+// 1 << (31 - b) in the first dimension, and the 1, 11, 101, 1111, ...
+// pattern of the second, shifted to the top
+constexpr std::pair<uint32_t, uint32_t> sobol_bits(uint32_t i) {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    for (uint32_t v = 1u << 31, b = 0; i; i >>= 1, v ^= v >> 1, b++) {
+        if (i & 1) {
+            x ^= 1u << (31 - b);
+            y ^= v;
+        }
+    }
+    return { x, y };
+}
+
+// The first `kSobolTableSize` points, in the two dimensions
+struct SobolTable {
+    std::array<uint32_t, kSobolTableSize> x {};
+    std::array<uint32_t, kSobolTableSize> y {};
+};
+
+constexpr SobolTable make_sobol_table() {
+    SobolTable table;
+    for (uint32_t i = 0; i < kSobolTableSize; i++) {
+        table.x[i] = sobol_bits(i).first;
+        table.y[i] = sobol_bits(i).second;
+    }
+    return table;
+}
+
+// Filled in at compile time
+constexpr SobolTable kSobolTable = make_sobol_table();
+
+// Fixed point in [0, 1) to float, keeping the 24 bits a float can hold so
+// that nothing rounds up to 1
+float to_unit(uint32_t x) {
+    return (float)(x >> 8) * 5.9604645e-8f; // / 0x1000000
+}
+
+// Like the Hammersley set of 2^k points, the first 2^k points are
+// stratified, for every k, so sampling can stop at any power of two
+std::pair<float, float> sobol_02(uint32_t i) {
+    auto [x, y] = sobol_bits(i);
+    return { to_unit(x), to_unit(y) };
+}
+
+// https://nullprogram.com/blog/2018/07/31/ (lowbias32)
+uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+    x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+    return x;
+}
+
+// Owen scrambling: each bit is flipped depending on the bits above it and
+// on `seed`, which keeps every elementary interval of a net in one piece
+// Burley, "Practical Hash-based Owen Scrambling", JCGT 2020
+uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits(x);
+    // Laine-Karras permutation: bits only affect the bits above them
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return reverse_bits(x);
+}
+
+// Ranks of a `kMaskSize` by `kMaskSize` blue-noise mask, from Ulichney's
+// void-and-cluster method: pixels are ranked by repeatedly taking the
+// largest void (or tightest cluster) of the pixels ranked so far, with a
+// Gaussian filter on the torus measuring how crowded each pixel is
+std::vector<uint16_t> make_blue_noise() {
+    constexpr int kPixels = kMaskSize * kMaskSize;
+    constexpr int kRadius = 6; // of the filter, about 3 sigmas
+    constexpr float kSigma = 1.9f;
+    float kernel[2 * kRadius + 1][2 * kRadius + 1];
+    for (int dy = -kRadius; dy <= kRadius; dy++) {
+        for (int dx = -kRadius; dx <= kRadius; dx++) {
+            kernel[dy + kRadius][dx + kRadius] = std::exp(-(dx * dx + dy * dy) / (2 * kSigma * kSigma));
+        }
+    }
+    std::vector<float> energy(kPixels, 0.0f);
+    std::vector<bool> on(kPixels, false);
+    auto toggle = [&](int p) {
+        float sign = on[p] ? -1.0f : 1.0f;
+        on[p] = !on[p];
+        int px = p % kMaskSize;
+        int py = p / kMaskSize;
+        for (int dy = -kRadius; dy <= kRadius; dy++) {
+            for (int dx = -kRadius; dx <= kRadius; dx++) {
+                int q = ((py + dy) & (kMaskSize - 1)) * kMaskSize + ((px + dx) & (kMaskSize - 1));
+                energy[q] += sign * kernel[dy + kRadius][dx + kRadius];
+            }
+        }
+    };
+    auto tightest_cluster = [&]() {
+        int best = -1;
+        for (int p = 0; p < kPixels; p++) {
+            if (on[p] && (best < 0 || energy[p] > energy[best])) {
+                best = p;
+            }
+        }
+        return best;
+    };
+    auto largest_void = [&]() {
+        int best = -1;
+        for (int p = 0; p < kPixels; p++) {
+            if (!on[p] && (best < 0 || energy[p] < energy[best])) {
+                best = p;
+            }
+        }
+        return best;
+    };
+
+    // Initial pattern: a tenth of the pixels at random, then moved from
+    // clusters to voids until that changes nothing
+    constexpr int kInitial = kPixels / 10;
+    std::minstd_rand random(221);
+    for (int placed = 0; placed < kInitial;) {
+        int p = std::uniform_int_distribution<int>(0, kPixels - 1)(random);
+        if (!on[p]) {
+            toggle(p);
+            placed++;
+        }
+    }
+    for (int moves = 0; moves < kPixels; moves++) {
+        int cluster = tightest_cluster();
+        toggle(cluster);
+        int hole = largest_void();
+        toggle(hole);
+        if (hole == cluster) {
+            break;
+        }
+    }
+
+    std::vector<uint16_t> rank(kPixels);
+    // Rank the initial pattern from its tightest clusters down...
+    std::vector<float> initial_energy = energy;
+    std::vector<bool> initial_on = on;
+    for (int r = kInitial - 1; r >= 0; r--) {
+        int cluster = tightest_cluster();
+        rank[cluster] = r;
+        toggle(cluster);
+    }
+    // ...and the other pixels from the largest voids up
+    energy = std::move(initial_energy);
+    on = std::move(initial_on);
+    for (int r = kInitial; r < kPixels; r++) {
+        int hole = largest_void();
+        rank[hole] = r;
+        toggle(hole);
+    }
+    return rank;
+}
+
+// Rank in [0, 4096) of mask pixel `(x, y)`, wrapping around
+uint32_t blue_noise(uint32_t x, uint32_t y) {
+    static std::vector<uint16_t> const mask = make_blue_noise(); // built on first use
+    return mask[(y & (kMaskSize - 1)) * kMaskSize + (x & (kMaskSize - 1))];
+}
+
+uint32_t Sampler::pixel_id(int i, int j) {
+    return (uint32_t)i << 16 | ((uint32_t)j & 0xFFFF);
+}
+
+Sampler::Sampler(SamplePattern pattern, uint32_t dimension)
+    : pattern(pattern) {
+    // Passes are told apart like dimensions, so that pass 0 samples the
+    // same as a single render
+    dimension += Sampler::pass * 0x9E3779B9u;
+    if (pattern == SamplePattern::Sobol) {
+        // The same shift for every pixel; none in the first pass
+        if (Sampler::pass) {
+            this->seed_x = hash32(dimension);
+            this->seed_y = hash32(this->seed_x);
+        }
+    } else if (pattern == SamplePattern::OwenSobol) {
+        uint32_t seed = hash32(Sampler::pixel ^ hash32(dimension));
+        this->seed_x = seed;
+        this->seed_y = hash32(seed);
+    } else if (pattern == SamplePattern::BlueNoise) {
+        // Each coordinate of each dimension reads the mask at its own
+        // offset, so that they aren't correlated with each other. The rank
+        // sets the top 12 bits of the shift, the hash the others.
+        uint32_t x = Sampler::pixel & 0xFFFF;
+        uint32_t y = Sampler::pixel >> 16;
+        uint32_t offset = hash32(dimension);
+        uint32_t low = hash32(Sampler::pixel ^ offset) >> 12;
+        this->seed_x = blue_noise(x + offset, y + (offset >> 8)) << 20 | low;
+        this->seed_y = blue_noise(x + (offset >> 16), y + (offset >> 24)) << 20 | (hash32(low) >> 12);
+    }
+}
+
+std::pair<float, float> Sampler::get(uint32_t index) const {
+    auto [x, y] = index < kSobolTableSize ? std::make_pair(kSobolTable.x[index], kSobolTable.y[index]) : sobol_bits(index);
+    if (this->pattern == SamplePattern::OwenSobol) {
+        x = owen_scramble(x, this->seed_x);
+        y = owen_scramble(y, this->seed_y);
+    } else {
+        // A digital shift keeps the points a net, like Owen scrambling
+        x ^= this->seed_x;
+        y ^= this->seed_y;
+    }
+    return { to_unit(x), to_unit(y) };
+}
+
+SamplerScope::SamplerScope(uint32_t pass)
+    : saved_pixel(Sampler::pixel)
+    , saved_pass(Sampler::pass) {
+    Sampler::pass = pass;
+}
+
+SamplerScope::~SamplerScope() {
+    Sampler::pixel = this->saved_pixel;
+    Sampler::pass = this->saved_pass;
+}
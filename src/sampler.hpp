@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+/**
+ * @brief Point sets a `Sampler` draws from (see `RenderSettings::sampler`).
+ */
+enum class SamplePattern {
+    Sobol, // the same points at every pixel, whose structure can alias
+    OwenSobol, // Sobol points, Owen-scrambled differently for each pixel and dimension
+    BlueNoise // Sobol points, XOR-shifted by a blue-noise mask, so that neighbors' errors differ
+};
+
+// First two dimensions of the Sobol sequence, as uniform samples in [0, 1)^2
+std::pair<float, float> sobol_02(uint32_t i);
+
+// Integer hash with good avalanche, to derive random numbers from counters
+// (pixels, dimensions, ...) rather than from generators with state
+uint32_t hash32(uint32_t x);
+
+/**
+ * @brief Samples of [0, 1)^2 for one estimate at one pixel, e.g., the
+ * reflection `PBRMaterial` samples at a hit.
+ *
+ * Scrambling keeps every power-of-two prefix of the samples stratified,
+ * like the plain Sobol points. The samples only depend on the pixel, the
+ * dimension and their index, never on which thread renders what, so
+ * images are deterministic.
+ */
+class Sampler {
+public:
+    // Pixel the calling thread is shading (see `pixel_id()`); set by the
+    // render loops before the rays of each pixel are traced, and restored
+    // by `SamplerScope` after each tile
+    inline static thread_local uint32_t pixel = 0;
+    // Pass of `SceneBase::render_progressive()` the calling thread renders
+    // (see `SamplerScope`), 0 otherwise; each pass gets its own scrambling,
+    // even with `SamplePattern::Sobol`
+    inline static thread_local uint32_t pass = 0;
+
+    // Identifier of the pixel at row `i`, column `j`
+    static uint32_t pixel_id(int i, int j);
+
+    /**
+     * @param pattern Point set to draw from
+     * @param dimension Which estimate along the pixel's paths this is
+     * (e.g., the recursion depth left); each has its own scrambling
+     */
+    Sampler(SamplePattern pattern, uint32_t dimension);
+
+    // Sample `index`; the first 1024 come from a precomputed table
+    std::pair<float, float> get(uint32_t index) const;
+
+private:
+    SamplePattern pattern;
+    // Owen scrambling seeds, or digital shifts with the other patterns
+    uint32_t seed_x = 0;
+    uint32_t seed_y = 0;
+};
+
+/**
+ * @brief Sets `Sampler::pass` for the calling thread while alive, then
+ * restores it and `Sampler::pixel`, so that what a thread rendered doesn't
+ * change the samples it draws afterwards (e.g., in a direct
+ * `SceneBase::trace()`).
+ */
+class SamplerScope {
+public:
+    explicit SamplerScope(uint32_t pass);
+    SamplerScope(SamplerScope const&) = delete;
+    SamplerScope& operator=(SamplerScope const&) = delete;
+    ~SamplerScope();
+
+private:
+    uint32_t saved_pixel;
+    uint32_t saved_pass;
+};
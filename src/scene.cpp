@@ -1,8 +1,15 @@
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <unordered_map>
 #include <chrono> // for measuring rendering time
+#include <functional>
+
+#include <omp.h>
 
 #include "scene.hpp"
 
@@ -65,7 +72,52 @@ Point Screen::get_pixel(float x, float y, Camera* cam) const {
     return pixel;
 }
 
-Scene::Scene(Camera* cam, Screen* scr, float ambient, float specular, float sp, Color background)
+RayGenerator::RayGenerator(Camera const& camera, Screen const& screen, int width, int height,
+    float offset_x, float offset_y)
+    : origin(camera.get_position())
+    , corner(0, 0, 0)
+    , step_x(0, 0, 0)
+    , step_y(0, 0, 0)
+    , offset_x(offset_x)
+    , offset_y(offset_y) {
+    // Same basis as `Screen::get_pixel()`, which is linear in the pixel
+    // coordinates, so it reduces to a corner and two steps
+    Vector orientation = camera.get_orientation();
+    Point center = this->origin + !orientation * screen.get_dst_cam();
+    Vector x_vector = !orientation ^ Vector(0, 0, 1);
+    Vector y_vector = x_vector ^ orientation;
+    Point top_left = center - (0.5f * screen.get_width()) * x_vector + (0.5f * screen.get_length()) * y_vector;
+    this->corner = top_left - this->origin;
+    this->step_x = (screen.get_width() / width) * x_vector;
+    this->step_y = -(screen.get_length() / height) * y_vector;
+}
+
+Ray RayGenerator::ray(int i, int j) const {
+    return this->ray(i, j, this->offset_x, this->offset_y);
+}
+
+Ray RayGenerator::ray(int i, int j, float offset_x, float offset_y) const {
+    Vector direction = this->corner + ((float)j + offset_x) * this->step_x + ((float)i + offset_y) * this->step_y;
+    return Ray(this->origin, direction);
+}
+
+void RayGenerator::packet(int i, int j, int count, RayPacket& packet) const {
+    // Consecutive pixels of a row are `step_x` apart
+    Vector first = this->ray(i, j).direction;
+    PacketFloat lanes;
+    for (int k = 0; k < kPacketSize; k++) {
+        lanes[k] = (float)k;
+    }
+    packet.ox = packet_broadcast(this->origin.x);
+    packet.oy = packet_broadcast(this->origin.y);
+    packet.oz = packet_broadcast(this->origin.z);
+    packet.dx = first.x + lanes * this->step_x.x;
+    packet.dy = first.y + lanes * this->step_x.y;
+    packet.dz = first.z + lanes * this->step_x.z;
+    packet.active = packet_first_lanes(count);
+}
+
+SceneBase::SceneBase(Camera* cam, Screen* scr, float ambient, float specular, float sp, Color background)
     : camera(cam)
     , screen(scr)
     , ambient(ambient)
@@ -74,107 +126,544 @@ Scene::Scene(Camera* cam, Screen* scr, float ambient, float specular, float sp,
     , background(background) {
 }
 
-Camera* Scene::get_camera() const {
+Camera* SceneBase::get_camera() const {
     return this->camera;
 }
 
-Screen* Scene::get_screen() const {
+Screen* SceneBase::get_screen() const {
     return this->screen;
 }
 
-float Scene::get_ambient() const {
+float SceneBase::get_ambient() const {
     return this->ambient;
 }
 
-float Scene::get_specular() const {
+float SceneBase::get_specular() const {
     return this->specular;
 }
 
-float Scene::get_sp() const {
+float SceneBase::get_sp() const {
     return this->sp;
 }
 
-Color Scene::get_background() const {
+Color SceneBase::get_background() const {
     return this->background;
 }
 
-void Scene::add_shape(std::unique_ptr<Shape>&& shape) {
-    this->shapes.push_back(std::move(shape));
+RenderSettings const& SceneBase::get_settings() const {
+    return this->settings;
+}
+
+void SceneBase::set_settings(RenderSettings const& settings) {
+    this->settings = settings;
+    this->radiance_cache->configure(settings.radiance_cache);
 }
 
-void Scene::add_light(std::unique_ptr<Light>&& light) {
+void SceneBase::add_light(std::unique_ptr<Light>&& light) {
     this->lights.push_back(std::move(light));
+    this->radiance_cache->clear();
+}
+
+Tile SceneBase::render_window(int width, int height) const {
+    Tile window { 0, 0, width, height };
+    if (this->settings.region) {
+        Tile const& region = this->settings.region.value();
+        window = Tile { std::max(0, region.x0), std::max(0, region.y0),
+            std::min(width, region.x1), std::min(height, region.y1) };
+        window.x1 = std::max(window.x0, window.x1);
+        window.y1 = std::max(window.y0, window.y1);
+    }
+    return window;
 }
 
-std::vector<Color> Scene::render(int width, int height) const {
-    std::vector<Color> output;
-    // The size of the output vector is known, so reserve the space needed in advance
-    output.reserve(width * height);
+std::vector<Color> SceneBase::render_rows(int width, int height, RenderStats* stats, CancelToken const* cancel,
+    RenderPass const& pass, AOVBuffers* aovs) const {
+    auto start_time = std::chrono::steady_clock::now();
+    this->radiance_cache->next_frame();
+    RayGenerator rays(*this->camera, *this->screen, width, height, pass.offset_x, pass.offset_y);
+    Tile window = this->render_window(width, height);
+    // Every pixel is written exactly once, so threads can write to
+    // different indices of the output without needing synchronization
+    std::vector<Color> output(width * height, Color::black());
+    std::vector<TileTiming> timings;
+#ifdef RAYTRACER_STATS
+    // Counters are reset before each tile (or row) and collected after it,
+    // so it doesn't matter which OpenMP threads end up running them
+    std::vector<RayCounters> thread_totals(omp_get_max_threads());
+#endif
+    // Antialiasing needs the primary hits of every pixel, then a second
+    // round over the tiles to supersample the pixels on edges; the
+    // denoiser needs them once the image is done
+    bool antialias = !pass.tiles && this->settings.antialiasing.max_depth > 0;
+    bool denoise_image = !pass.tiles && this->settings.denoiser.enabled;
+    bool gather = antialias || denoise_image || aovs;
+    GBuffer gbuffer;
+    std::vector<bool> edges;
+    if (gather) {
+        gbuffer.reset(width, height);
+    }
+    auto render_tile = [&](Tile const& tile) {
+#ifdef RAYTRACER_STATS
+        thread_counters = RayCounters();
+#endif
+        SamplerScope samples(pass.index);
+        for (int i = tile.y0; i < tile.y1; i++) {
+            if (!edges.empty()) {
+                for (int j = tile.x0; j < tile.x1; j++) {
+                    if (edges[i * width + j]) {
+                        STATS_ADD(supersampled_pixels, 1);
+                        int depth = this->settings.antialiasing.max_depth;
+                        output[i * width + j] = this->supersample(rays, i, j, 0.0f, 0.0f, 1.0f, depth);
+                    }
+                }
+                continue;
+            }
+            this->render_span(rays, i, tile.x0, tile.x1, &output[i * width], gather ? &gbuffer : nullptr);
+            if (aovs) {
+                this->gather_aovs(rays, i, tile.x0, tile.x1, gbuffer, *aovs);
+            }
+        }
+#ifdef RAYTRACER_STATS
+        thread_totals[omp_get_thread_num()].merge(thread_counters);
+#endif
+    };
+
     // Here's the hot loop of the ray tracer
-    auto start_time = std::chrono::high_resolution_clock::now(); // Start measuring time
-    #pragma omp parallel for schedule(dynamic) // Parallelize the outer loop with OpenMP
-    for (int i = 0; i < height; i++) {
-        // adjust by 0.5 so that the ray points to the center of the pixel
-        // instead of the top-left corner
-        float screen_y = ((float)i + 0.5f) / height;
-        for (int j = 0; j < width; j++) {
-            float screen_x = ((float)j + 0.5f) / width;
-            Point destination = this->screen->get_pixel(screen_x, screen_y, this->camera); // TODO: check order
-            Vector direction = destination - this->camera->get_position();
-            Color color = trace(Ray(this->camera->get_position(), direction), this->recursion_depth);
-            color.clamp();
-            output[i * width + j] = color; // Thread safely write to different indices of the output vector without needing synchronization
-        }
-    }
-    auto end_time = std::chrono::high_resolution_clock::now(); // End measuring time
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
-    std::cout << "Rendering completed in " << duration << " milliseconds." << std::endl;
+    if (pass.tiles) {
+        timings = TileScheduler(*pass.tiles).run(render_tile, cancel);
+    } else if (this->settings.schedule == RenderSchedule::Tiles) {
+        TileScheduler scheduler(window, this->settings.tile_size, this->settings.tile_order);
+        timings = scheduler.run(render_tile, cancel);
+    } else {
+        if (stats) {
+            timings.resize(window.y1 - window.y0, TileTiming { Tile { 0, 0, 0, 0 }, 0, 0.0 });
+        }
+        #pragma omp parallel for schedule(dynamic) // Parallelize the outer loop with OpenMP
+        for (int i = window.y0; i < window.y1; i++) {
+            if (cancel && cancel->is_cancelled()) {
+                continue; // OpenMP loops can't break
+            }
+            auto row_start = std::chrono::steady_clock::now();
+            Tile row { window.x0, i, window.x1, i + 1 };
+            render_tile(row);
+            if (stats) {
+                auto row_end = std::chrono::steady_clock::now();
+                double ms = std::chrono::duration<double, std::milli>(row_end - row_start).count();
+                timings[i - window.y0] = TileTiming { row, omp_get_thread_num(), ms };
+            }
+        }
+    }
+
+    if (antialias && !(cancel && cancel->is_cancelled())) {
+        // Edges are found on the whole image first, so that no pixel is
+        // supersampled while its neighbors still compare it to others
+        edges = this->find_edges(window, output, gbuffer);
+        TileScheduler(window, this->settings.tile_size, this->settings.tile_order).run(render_tile, cancel);
+    }
+    if (denoise_image && !(cancel && cancel->is_cancelled())) {
+        denoise(output, gbuffer, window, this->settings.denoiser);
+    }
+
+    if (stats) {
+        auto end_time = std::chrono::steady_clock::now();
+        *stats = RenderStats();
+        stats->milliseconds = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        stats->tile_timings = std::move(timings);
+#ifdef RAYTRACER_STATS
+        for (RayCounters const& totals : thread_totals) {
+            stats->counters.merge(totals);
+        }
+#endif
+    }
     return output;
 }
 
+void SceneBase::gather_aovs(RayGenerator const& rays, int i, int x0, int x1, GBuffer const& gbuffer, AOVBuffers& aovs) const {
+    for (int j = x0; j < x1; j++) {
+        int p = i * gbuffer.width + j;
+        Shape const* shape = gbuffer.shape[p];
+        Ray ray = rays.ray(i, j);
+        if (aovs.settings.lighting) {
+            // Without recursion, only what is shaded at the hit is left;
+            // neither is clamped, so that they add up to what the pixel
+            // would be without clamping
+            Sampler::pixel = Sampler::pixel_id(i, j);
+            Color direct = this->shade_hit(ray, gbuffer.depth[p], shape, 0);
+            aovs.set_lighting(p, direct, gbuffer.radiance[p] - direct);
+        }
+        if (shape) {
+            aovs.set_hit(p, gbuffer.depth[p], ray.at(gbuffer.depth[p]), gbuffer.normal[p], shape->get_id(), gbuffer.albedo[p]);
+        }
+    }
+}
+
+std::vector<bool> SceneBase::find_edges(Tile const& window, std::vector<Color> const& image, GBuffer const& gbuffer) const {
+    AntialiasingSettings const& antialiasing = this->settings.antialiasing;
+    int width = gbuffer.width;
+    std::vector<bool> edges(image.size(), false);
+    auto differ = [&](int p, int q) {
+        float t_p = gbuffer.depth[p];
+        float t_q = gbuffer.depth[q];
+        Shape const* shape_p = gbuffer.shape[p];
+        if (shape_p != gbuffer.shape[q]) {
+            return true;
+        }
+        if (shape_p && std::abs(t_p - t_q) > antialiasing.depth * std::min(t_p, t_q)) {
+            return true;
+        }
+        return std::abs(image[p].luminance() - image[q].luminance()) > antialiasing.contrast;
+    };
+    // Compare each pixel with its right and bottom neighbors
+    for (int i = window.y0; i < window.y1; i++) {
+        for (int j = window.x0; j < window.x1; j++) {
+            int p = i * width + j;
+            if (j + 1 < window.x1 && differ(p, p + 1)) {
+                edges[p] = edges[p + 1] = true;
+            }
+            if (i + 1 < window.y1 && differ(p, p + width)) {
+                edges[p] = edges[p + width] = true;
+            }
+        }
+    }
+    return edges;
+}
+
+Color SceneBase::supersample(RayGenerator const& rays, int i, int j, float x, float y, float size, int depth) const {
+    Sampler::pixel = Sampler::pixel_id(i, j);
+    float half = size / 2;
+    Color samples[4] = { Color::black(), Color::black(), Color::black(), Color::black() };
+    float luminances[4];
+    float mean = 0.0f;
+    for (int q = 0; q < 4; q++) {
+        STATS_ADD(primary_rays, 1);
+        float offset_x = x + (q & 1 ? 1.5f : 0.5f) * half;
+        float offset_y = y + (q & 2 ? 1.5f : 0.5f) * half;
+        samples[q] = this->trace(rays.ray(i, j, offset_x, offset_y), this->recursion_depth);
+        samples[q].clamp();
+        luminances[q] = samples[q].luminance();
+        mean += luminances[q] / 4;
+    }
+    Color color = Color::black();
+    for (int q = 0; q < 4; q++) {
+        if (depth > 1 && std::abs(luminances[q] - mean) > this->settings.antialiasing.contrast) {
+            samples[q] = this->supersample(rays, i, j, x + (q & 1) * half, y + (q >> 1) * half, half, depth - 1);
+        }
+        color = color + samples[q] * 0.25f;
+    }
+    return color;
+}
+
+std::vector<Color> SceneBase::render_aovs(int width, int height, AOVBuffers& aovs, RenderStats* stats,
+    CancelToken const* cancel) const {
+    this->update_bvh();
+    aovs.reset(width, height);
+    return this->render_rows(width, height, stats, cancel, RenderPass(), &aovs);
+}
+
+std::vector<Color> SceneBase::render_progressive(int width, int height, ProgressiveSettings const& progressive,
+    std::function<void(ProgressiveFrame const&)> const& on_pass, RenderStats* stats, CancelToken const* cancel) const {
+    auto start_time = std::chrono::steady_clock::now();
+    auto elapsed = [&]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    };
+    this->update_bvh();
+    std::vector<Tile> tiles = TileScheduler(this->render_window(width, height), this->settings.tile_size, this->settings.tile_order).get_tiles();
+    // Finished tiles are reported by position
+    std::unordered_map<int, int> tile_index;
+    for (std::size_t t = 0; t < tiles.size(); t++) {
+        tile_index[tiles[t].y0 * width + tiles[t].x0] = t;
+    }
+
+    // Running sums of every pixel over the passes of its tile
+    std::vector<Color> sum(width * height, Color::black());
+    std::vector<float> sum_squares(width * height, 0.0f); // of the luminance
+    std::vector<int> passes(tiles.size(), 0); // of each tile
+    std::vector<bool> active(tiles.size(), true);
+    std::vector<Tile> pass_tiles = tiles; // tiles of the next pass, in curve order
+    std::vector<Color> image(width * height, Color::black());
+
+    // The deadline stops a pass halfway; only the tiles it finished count
+    CancelToken budget;
+    if (progressive.time_budget > 0) {
+        budget.cancel_at(start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                             std::chrono::duration<double, std::milli>(progressive.time_budget)));
+    }
+    CancelToken const* stop = progressive.time_budget > 0 ? &budget : cancel;
+
+    RenderStats totals;
+    int pass = 0;
+    for (; pass < progressive.max_passes && !pass_tiles.empty(); pass++) {
+        if ((cancel && cancel->is_cancelled()) || budget.is_cancelled()) {
+            break;
+        }
+        // Jitter along the Sobol points, shifted so that pass 0 goes
+        // through the centers of the pixels like `render()`
+        auto [u, v] = sobol_02(pass);
+        RenderPass render_pass;
+        render_pass.index = pass;
+        render_pass.offset_x = u < 0.5f ? u + 0.5f : u - 0.5f;
+        render_pass.offset_y = v < 0.5f ? v + 0.5f : v - 0.5f;
+        render_pass.tiles = &pass_tiles;
+        RenderStats pass_stats;
+        std::vector<Color> frame = this->render_rows(width, height, &pass_stats, stop, render_pass);
+
+        for (TileTiming const& timing : pass_stats.tile_timings) {
+            Tile const& tile = timing.tile;
+            int t = tile_index[tile.y0 * width + tile.x0];
+            int n = ++passes[t];
+            float max_error = 0.0f;
+            for (int i = tile.y0; i < tile.y1; i++) {
+                for (int j = tile.x0; j < tile.x1; j++) {
+                    int p = i * width + j;
+                    float luminance = frame[p].luminance();
+                    sum[p] = sum[p] + frame[p];
+                    sum_squares[p] += luminance * luminance;
+                    image[p] = sum[p] * (1.0f / n);
+                    if (n > 1) {
+                        // Standard error of the mean, from the sample variance
+                        float mean = sum[p].luminance() / n;
+                        float variance = std::max(0.0f, (sum_squares[p] - n * mean * mean) / (n - 1));
+                        max_error = std::max(max_error, std::sqrt(variance / n));
+                    }
+                }
+            }
+            bool converged = progressive.tolerance > 0 && n >= progressive.min_passes && max_error <= progressive.tolerance;
+            if (converged || n >= progressive.max_passes) {
+                active[t] = false;
+            }
+        }
+        pass_tiles.clear();
+        for (std::size_t t = 0; t < tiles.size(); t++) {
+            if (active[t]) {
+                pass_tiles.push_back(tiles[t]);
+            }
+        }
+
+        totals.counters.merge(pass_stats.counters);
+        totals.tile_timings.insert(totals.tile_timings.end(), pass_stats.tile_timings.begin(), pass_stats.tile_timings.end());
+        if (on_pass) {
+            on_pass(ProgressiveFrame { image, pass + 1, (int)pass_tiles.size(), elapsed() });
+        }
+    }
+
+    if (stats) {
+        *stats = std::move(totals);
+        stats->milliseconds = elapsed();
+        stats->passes = pass;
+    }
+    return image;
+}
+
+void SceneBase::render_iterative(RayGenerator const& rays, int i, int x0, int x1, Color* output, GBuffer* gbuffer) const {
+    // Reused by every row the thread renders, so it only allocates until
+    // it is big enough
+    thread_local RayTree tree;
+    tree.clear(this->settings.ray_budget);
+    for (int j = x0; j < x1; j++) {
+        STATS_ADD(primary_rays, 1);
+        tree.add_root(rays.ray(i, j), this->recursion_depth, Sampler::pixel_id(i, j));
+    }
+    // Nodes are shaded in the order they were added, so each generation
+    // of rays (all primary rays, then all rays they spawn, and so on) is
+    // shaded before the next. Within a generation the order doesn't
+    // matter, which leaves room for sorting rays by direction.
+    RayTree::active = &tree;
+    for (std::size_t n = 0; n < tree.nodes.size(); n++) {
+        tree.begin(n);
+        RayTree::Node const& node = tree.nodes[n];
+        // The primary rays come first, in pixel order
+        if ((int)n < x1 - x0) {
+            GBuffer::begin(gbuffer, i, x0 + n);
+        }
+        // `node` is invalidated as children are added
+        Color color = this->trace(node.ray, node.depth, node.weight);
+        GBuffer::active = nullptr;
+        tree.nodes[n].color = color;
+    }
+    RayTree::active = nullptr;
+    tree.resolve();
+    for (int j = x0; j < x1; j++) {
+        Color color = tree.nodes[j - x0].color;
+        GBuffer::record_radiance(gbuffer, i, j, color);
+        color.clamp();
+        output[j] = color;
+    }
+}
+
+Color SceneBase::cached_radiance(Ray const& ray, Vector const& normal, float weight) const {
+    uint64_t key = this->radiance_cache->key(ray.origin, normal, ray.direction);
+    if (std::optional<Color> radiance = this->radiance_cache->find(key)) {
+        STATS_ADD(cache_hits, 1);
+        return radiance.value();
+    }
+    STATS_ADD(reflection_rays, 1);
+    Color radiance = this->trace(ray, 0, weight);
+    this->radiance_cache->add(key, radiance);
+    return radiance;
+}
+
+float SceneBase::prune(float weight, int recursion_depth) const {
+    if (this->settings.russian_roulette && weight > 0) {
+        // Hash what identifies the ray instead of drawing from a generator,
+        // whose state would depend on which thread rendered what before;
+        // the weight tells apart the branches leaving the same hit
+        uint32_t weight_bits;
+        std::memcpy(&weight_bits, &weight, sizeof(weight_bits));
+        uint32_t key = hash32(Sampler::pass ^ hash32(weight_bits ^ hash32((uint32_t)recursion_depth)));
+        float random = (hash32(Sampler::pixel ^ key) >> 8) * (1.0f / (1u << 24));
+        float survival = weight / this->settings.min_weight;
+        if (random < survival) {
+            return 1.0f / survival;
+        }
+    }
+    STATS_ADD(pruned_rays, 1);
+    return 0.0f;
+}
+
+bool SceneBase::is_light_visible(Light const& light, Point const& point, Vector const& normal) const {
+    return is_light_visible_in(*this, light, point, normal);
+}
+
+void Scene::add_shape(std::unique_ptr<Shape>&& shape) {
+    if (shape->primitive_kind() != PrimitiveKind::Custom) {
+        this->primitives.add(shape.get());
+    } else if (shape->bounds()) {
+        this->bounded.push_back(shape.get());
+        this->bvh_dirty = true;
+    } else {
+        this->unbounded.push_back(shape.get());
+    }
+    shape->id = ++this->shape_count;
+    this->shapes.push_back(std::move(shape));
+    this->radiance_cache->clear();
+}
+
+void Scene::update_bvh() const {
+    this->primitives.build();
+    if (!this->bvh_dirty) {
+        return;
+    }
+    std::vector<AABB> bounds;
+    bounds.reserve(this->bounded.size());
+    for (Shape const* shape : this->bounded) {
+        bounds.push_back(shape->bounds().value());
+    }
+    this->bvh.build(bounds);
+    this->bvh_dirty = false;
+}
+
 std::optional<std::pair<float, std::reference_wrapper<Shape const>>> Scene::intersect_first_all(Ray const& ray) const {
     // Track the closest intersection the ray meets by far
-    std::optional<std::pair<float, std::reference_wrapper<Shape const>>> min_intersection {};
-    for (auto&& shape : this->shapes) {
+    float t_min = std::numeric_limits<float>::infinity();
+    Shape const* closest = this->primitives.intersect(ray, t_min);
+    auto test = [&](Shape const* shape) {
+        STATS_ADD(intersection_tests, 1);
         std::optional<float> t = shape->intersect_first(ray);
-        // Update `min_intersection` when there is a new intersection, and
-        // either there is currently no other intersections
-        // or the new intersection is smaller than the current one
-        if (t && (!min_intersection || t.value() < min_intersection.value().first)) {
-            min_intersection = std::make_pair(t.value(), std::cref(*shape));
+        // Update the closest intersection when there is a new intersection
+        // that is smaller than the current one
+        if (t && t.value() < t_min) {
+            t_min = t.value();
+            closest = shape;
+        }
+    };
+
+    if (this->bvh_dirty) {
+        // The BVH is out of date (shapes were added outside of `render()`)
+        for (Shape const* shape : this->bounded) {
+            test(shape);
         }
+    } else {
+        this->bvh.traverse(ray, t_min, [&](int index) {
+            test(this->bounded[index]);
+            return false; // keep looking for closer intersections
+        });
+    }
+    for (Shape const* shape : this->unbounded) {
+        test(shape);
     }
 
-    return min_intersection;
+    if (!closest) {
+        return {};
+    }
+    return std::make_pair(t_min, std::cref(*closest));
 }
 
-std::vector<std::reference_wrapper<Light const>> Scene::get_visible_point_lights(Point const& point) const {
-    std::vector<std::reference_wrapper<Light const>> visible_lights {};
-    for (auto&& light : this->lights) {
-        if (light->is_visible(point, *this)) {
-            visible_lights.push_back(std::cref(*light));
+void Scene::intersect_packet(RayPacket const& packet, PacketHit& hit) const {
+    // Same order as `intersect_first_all()`, so that ties go the same way
+    this->primitives.intersect(packet, hit);
+    auto test = [&](Shape const* shape) {
+        STATS_ADD(intersection_tests, kPacketSize); // one test per lane
+        shape->intersect_packet(packet, hit);
+    };
+    if (this->bvh_dirty) {
+        for (Shape const* shape : this->bounded) {
+            test(shape);
         }
+    } else {
+        this->bvh.traverse_packet(packet, hit.t, [&](int index) {
+            test(this->bounded[index]);
+        });
+    }
+    for (Shape const* shape : this->unbounded) {
+        test(shape);
     }
+}
 
-    return visible_lights;
+bool Scene::occluded(Ray const& ray, float t_max) const {
+    if (this->primitives.occluded(ray, t_max)) {
+        return true;
+    }
+    auto test = [&](Shape const* shape) {
+        STATS_ADD(intersection_tests, 1);
+        return shape->intersects_any(ray, t_max);
+    };
+    // Unbounded shapes are usually few and large, so test them first
+    for (Shape const* shape : this->unbounded) {
+        if (test(shape)) {
+            return true;
+        }
+    }
+    if (this->bvh_dirty) {
+        for (Shape const* shape : this->bounded) {
+            if (test(shape)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return this->bvh.traverse(ray, t_max, [&](int index) {
+        return test(this->bounded[index]);
+    });
 }
 
-Color Scene::trace(Ray const& ray, int recursion_depth) const {
+Color Scene::trace(Ray const& ray, int recursion_depth, float weight) const {
     // Compute the first intersection (if any)
     std::optional<std::pair<float, std::reference_wrapper<Shape const>>> min_intersection = this->intersect_first_all(ray);
-
     if (min_intersection) {
         auto [t, shape] = min_intersection.value();
-        Point point = ray.at(t);
+        return this->shade(ray, t, &shape.get(), recursion_depth, weight);
+    }
+    return this->shade(ray, 0.0f, nullptr, recursion_depth, weight);
+}
 
-        // Get the material at the intersection point
-        std::unique_ptr<Material> material = shape.get().material_at(point);
+Color Scene::shade(Ray const& ray, float t, Shape const* shape, int recursion_depth, float weight) const {
+    STATS_DEPTH(this->recursion_depth - recursion_depth);
+    if (!shape) {
+        return this->background;
+    }
+    Point point = ray.at(t);
+
+    // Get the material at the intersection point; procedural materials
+    // are constructed in `storage` instead of on the heap
+    MaterialStorage storage;
+    Material const& material = shape->material_at(point, storage);
 
-        // Get the normal vector
-        Vector normal = shape.get().normal_at(point);
+    // Get the normal vector
+    Vector normal = shape->normal_at(point);
 
-        return material->get_color(ray.direction, point, normal, this, recursion_depth);
+    if (GBuffer::active) {
+        GBuffer::record(ray, t, shape, normal, material.albedo());
     }
 
-    return this->background;
+    return material.get_color(ray.direction, point, normal, this, recursion_depth, weight);
 }
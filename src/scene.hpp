@@ -1,13 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <numeric>
 #include <optional>
+#include <typeinfo>
 #include <utility>
 #include <vector>
 
+#include "aov.hpp"
+#include "bvh.hpp"
 #include "color.hpp"
+#include "denoiser.hpp"
+#include "gbuffer.hpp"
 #include "light.hpp"
+#include "packet.hpp"
+#include "primitives.hpp"
+#include "radiance_cache.hpp"
 #include "ray.hpp"
+#include "ray_tree.hpp"
+#include "sampler.hpp"
+#include "scheduler.hpp"
 #include "shape.hpp"
+#include "stats.hpp"
 #include "vector.hpp"
 
 // Forward declaration
@@ -63,12 +79,180 @@ public:
     Point get_pixel(float x, float y, Camera* cam) const;
 };
 
-class Scene {
+/**
+ * @brief Primary rays of one frame. The camera basis and the step between
+ * neighboring pixels are computed once per frame, so that each ray costs
+ * a few multiply-adds instead of a call to `Screen::get_pixel()`. This is
+ * where every renderer gets its primary rays from.
+ *
+ * Rays go through the point at `(offset_x, offset_y)` within each pixel,
+ * both in `[0, 1)` and `0.5` for the center; moving the offsets between
+ * frames (or per sample, with the overload of `ray()` taking them) jitters
+ * the rays for antialiasing.
+ */
+class RayGenerator {
 private:
+    Point origin; // position of the camera, shared by every ray
+    Vector corner; // from the camera to the top-left corner of pixel (0, 0)
+    Vector step_x; // from a pixel to the next one in its row
+    Vector step_y; // from a pixel to the next one in its column
+    float offset_x;
+    float offset_y;
+
+public:
+    RayGenerator(Camera const& camera, Screen const& screen, int width, int height,
+        float offset_x = 0.5f, float offset_y = 0.5f);
+
+    // Ray from the camera through pixel `(i, j)` (row `i`, column `j`)
+    Ray ray(int i, int j) const;
+    // Same, through the point at `(offset_x, offset_y)` within the pixel
+    Ray ray(int i, int j, float offset_x, float offset_y) const;
+
+    /**
+     * @brief Fill `packet` with the rays of pixels `j` to `j + count - 1`
+     * of row `i`, and activate the first `count` lanes (at most
+     * `kPacketSize`). The directions are computed for all lanes at once.
+     */
+    void packet(int i, int j, int count, RayPacket& packet) const;
+};
+
+/**
+ * @brief How `SceneBase::render()` distributes pixels among threads.
+ */
+enum class RenderSchedule {
+    Rows, // one row at a time, dynamically scheduled by OpenMP
+    Tiles // square tiles along a space-filling curve, with work stealing
+};
+
+/**
+ * @brief How `SceneBase::render()` traces secondary rays.
+ */
+enum class Integrator {
+    Recursive, // depth first, each ray as soon as it is spawned
+    Iterative, // breadth first from a `RayTree`, one ray at a time
+    Wavefront // breadth first, each generation intersected in packets and shaded by material
+};
+
+/**
+ * @brief Adaptive antialiasing (see `RenderSettings::antialiasing`). After
+ * one ray per pixel, pixels on an edge are split into quadrants, each
+ * sampled by one ray through its center and split again while its color
+ * stands out from the other quadrants, up to `max_depth` times.
+ */
+struct AntialiasingSettings {
+    int max_depth = 0; // 0 turns antialiasing off, 1 traces 4 rays per edge pixel, 2 up to 16, ...
+    // A pixel is on an edge when it sees another shape than a neighbor,
+    // when their hits are further apart than `depth` times their distance
+    // from the camera, or when their luminances differ by more than
+    // `contrast` (1 being white). Quadrants are split by `contrast` only.
+    float contrast = 1.0f / 16;
+    float depth = 0.1f;
+};
+
+/**
+ * @brief Options for `SceneBase::render()` that can be changed between frames.
+ */
+struct RenderSettings {
+    RenderSchedule schedule = RenderSchedule::Tiles;
+    int tile_size = 16; // side of a tile in pixels
+    TileOrder tile_order = TileOrder::Hilbert;
+    // If set, only the pixels in this window are rendered (clipped to the
+    // image); the others are left black
+    std::optional<Tile> region;
+    // Intersect primary rays in packets of `kPacketSize` neighboring
+    // pixels; secondary rays are always traced one at a time
+    bool packets = true;
+    // Reflected and refracted rays whose weight (how much they contribute
+    // to the pixel, e.g., the product of the reflectivities along the path)
+    // is below `min_weight` are not traced; 0 traces everything. With
+    // `russian_roulette`, they are instead traced at random with
+    // probability `weight / min_weight` and scaled up to compensate, which
+    // trades the slight darkening of pruning for noise.
+    float min_weight = 1.0f / 512;
+    bool russian_roulette = false;
+    // If nonzero, `PBRMaterial` takes fewer samples of faint or narrow
+    // reflections, and (for rays traced recursively) stops sampling once
+    // the estimated error of the luminance is below this (in linear units,
+    // 1 being white; e.g., 1/1024). 0, the default, takes every sample.
+    float sample_tolerance = 0.0f;
+    // Where the samples of `PBRMaterial` come from (see `Sampler`)
+    SamplePattern sampler = SamplePattern::Sobol;
+    // Reuse the radiance seen by `PBRMaterial` samples (see `RadianceCache`)
+    RadianceCacheSettings radiance_cache;
+    // Supersample edges; off by default. Not applied to the passes of
+    // `SceneBase::render_progressive()`, which are jittered instead.
+    AntialiasingSettings antialiasing;
+    // Filter the noise out of the image once it is rendered (see
+    // `denoise()`); off by default. Not applied to the passes of
+    // `SceneBase::render_progressive()`.
+    DenoiserSettings denoiser;
+    // Except with `Integrator::Recursive`, secondary rays are queued (see
+    // `RayTree`) instead of traced right away; the image is the same, up to
+    // the rounding of packets with `Integrator::Wavefront`. Primary rays
+    // are traced one at a time with `Integrator::Iterative`, regardless of
+    // `packets`.
+    Integrator integrator = Integrator::Recursive;
+    // Most rays each thread keeps queued, beyond which they are traced
+    // recursively again; a queued ray takes 68 bytes
+    int ray_budget = 1 << 15;
+};
+
+/**
+ * @brief When `SceneBase::render_progressive()` stops. Each tile stops
+ * once it has converged (or had `max_passes` passes), and the render once
+ * every tile has stopped or the time budget is spent.
+ */
+struct ProgressiveSettings {
+    int min_passes = 8; // before a tile can converge; fewer can agree by chance
+    int max_passes = 256;
+    // A tile has converged once the standard error of the mean luminance
+    // of each of its pixels is below this (in linear units, 1 being white);
+    // 0 always takes `max_passes`
+    float tolerance = 1.0f / 256;
+    // Stop after this long, in milliseconds, even in the middle of a pass;
+    // 0 for no limit
+    double time_budget = 0.0;
+};
+
+/**
+ * @brief Intermediate image of `SceneBase::render_progressive()`, handed
+ * to its callback after each pass.
+ */
+struct ProgressiveFrame {
+    std::vector<Color> const& image; // mean of the passes so far, laid out like `render()`'s
+    int passes; // done so far; tiles that stopped early may have had fewer
+    int active_tiles; // tiles that still get passes
+    double milliseconds; // since the render started
+};
+
+/**
+ * @brief What sets one pass of `SceneBase::render_progressive()` apart
+ * from `SceneBase::render()`.
+ */
+struct RenderPass {
+    uint32_t index = 0; // see `Sampler::pass`
+    // Where the primary rays go through within each pixel
+    float offset_x = 0.5f;
+    float offset_y = 0.5f;
+    // If set, only these tiles are rendered, regardless of
+    // `RenderSettings::schedule` and `RenderSettings::region`
+    std::vector<Tile> const* tiles = nullptr;
+};
+
+/**
+ * @brief Everything a scene has apart from its shapes: camera, screen,
+ * lights and shading parameters, plus the multithreaded render loop.
+ *
+ * Subclasses store the shapes and implement `trace()` and `occluded()`.
+ * `Scene` takes any shape at run time; `StaticScene` fixes the shape
+ * types at compile time so that nothing goes through virtual calls.
+ * Materials see scenes through this class (see `Material::get_color()`).
+ */
+class SceneBase {
+protected:
     Camera* camera;
     Screen* screen;
 
-    std::vector<std::unique_ptr<Shape>> shapes;
     std::vector<std::unique_ptr<Light>> lights;
 
     float ambient;
@@ -76,10 +260,104 @@ private:
     float sp;
     Color background;
     int recursion_depth = 6;
+    RenderSettings settings;
+    uint32_t shape_count = 0; // shapes added so far (see `Shape::get_id()`)
+    // Kept across frames, and cleared when shapes or lights are added.
+    // Behind a pointer so that scenes stay movable.
+    std::unique_ptr<RadianceCache> radiance_cache = std::make_unique<RadianceCache>();
+
+    // Slow path of `sample_radiance()`, with the cache enabled
+    Color cached_radiance(Ray const& ray, Vector const& normal, float weight) const;
+
+    // Slow path of `path_scale()`, for weights below `settings.min_weight`
+    float prune(float weight, int recursion_depth) const;
+
+    // Pixels to render: the whole image, or `settings.region` clipped to it
+    Tile render_window(int width, int height) const;
+
+    /**
+     * @brief Shared body of `render()`: split the image (or its region of
+     * interest) among threads as `settings` says, render it with
+     * `render_span()`, and fill in `stats` (see `render()`) and `aovs`
+     * (see `render_aovs()`), if not null.
+     */
+    std::vector<Color> render_rows(int width, int height, RenderStats* stats, CancelToken const* cancel,
+        RenderPass const& pass = RenderPass(), AOVBuffers* aovs = nullptr) const;
+
+    /**
+     * @brief Fill in the entries of `aovs` for columns `x0` to `x1 - 1` of
+     * row `i` from the primary hits and colors `render_span()` recorded in
+     * `gbuffer`.
+     */
+    void gather_aovs(RayGenerator const& rays, int i, int x0, int x1, GBuffer const& gbuffer, AOVBuffers& aovs) const;
+
+    // The scene's own `shade()`, for when the hit is already known
+    virtual Color shade_hit(Ray const& ray, float t, Shape const* shape, int recursion_depth) const = 0;
+
+    /**
+     * @brief Mark the pixels of `window` on an edge, as
+     * `settings.antialiasing` says, from their colors in `image` and their
+     * primary hits in `gbuffer` (laid out like the image).
+     */
+    std::vector<bool> find_edges(Tile const& window, std::vector<Color> const& image, GBuffer const& gbuffer) const;
+
+    /**
+     * @brief Mean color of the square of side `size` with top-left corner
+     * `(x, y)` within pixel `(i, j)` (in `[0, 1]`), from one ray through
+     * the center of each of its quadrants; quadrants that stand out are
+     * supersampled again while `depth` is above 1.
+     */
+    Color supersample(RayGenerator const& rays, int i, int j, float x, float y, float size, int depth) const;
+
+    /**
+     * @brief Render columns `x0` to `x1 - 1` of row `i` into `output[x0]`
+     * to `output[x1 - 1]`, as `settings.integrator` and `settings.packets`
+     * say, where `rays` gives the primary rays of the frame and `output`
+     * points to the start of the row. If `gbuffer` isn't null, the
+     * primary hits are recorded there too (see `GBuffer::record()`).
+     */
+    virtual void render_span(RayGenerator const& rays, int i, int x0, int x1, Color* output, GBuffer* gbuffer) const = 0;
+
+    /**
+     * @brief Render columns `x0` to `x1 - 1` of row `i` into `output[x0]`
+     * to `output[x1 - 1]` with `Integrator::Iterative`: every ray of the
+     * row goes through one `RayTree` per thread, a generation at a time.
+     */
+    void render_iterative(RayGenerator const& rays, int i, int x0, int x1, Color* output, GBuffer* gbuffer) const;
+
+    /**
+     * @brief Same as `render_iterative()` with `Integrator::Wavefront`: each
+     * generation of rays is sorted by direction and intersected in packets
+     * with `scene.intersect_packet()`, then binned by the type of the
+     * shape hit (which fixes the class of its material, e.g.,
+     * `BasicSphere<PBRMaterial>`) and shaded with `scene.shade()`, so that
+     * hits running the same material code are shaded together.
+     * @param scene This scene, as its own type
+     */
+    template <typename SceneT>
+    void render_wavefront(SceneT const& scene, RayGenerator const& rays, int i, int x0, int x1, Color* output,
+        GBuffer* gbuffer) const;
+
+    /**
+     * @brief Shared bodies of `trace_secondary()`, `sample_radiance()`,
+     * `is_light_visible()` and `for_each_visible_light()`, calling
+     * `scene.trace()` and `scene.occluded()`. `SceneBase` passes itself,
+     * for materials shading through `Material::get_color()`, and
+     * `SceneImpl` the concrete scene, so that those calls aren't virtual.
+     */
+    template <typename SceneT>
+    static Color trace_secondary_in(SceneT const& scene, Ray const& ray, int recursion_depth, Color const& factor, float weight);
+    template <typename SceneT>
+    static Color sample_radiance_in(SceneT const& scene, Ray const& ray, Vector const& normal, float weight);
+    template <typename SceneT>
+    static bool is_light_visible_in(SceneT const& scene, Light const& light, Point const& point, Vector const& normal);
+    template <typename SceneT, typename Func>
+    static void for_each_visible_light_in(SceneT const& scene, Point const& point, Vector const& normal, Func&& func);
 
 public:
-    Scene() = delete;
-    Scene(Camera* cam, Screen* scr, float ambient, float specular, float sp, Color background);
+    SceneBase() = delete;
+    SceneBase(Camera* cam, Screen* scr, float ambient, float specular, float sp, Color background);
+    virtual ~SceneBase() = default;
 
     Camera* get_camera() const;
     Screen* get_screen() const;
@@ -87,12 +365,10 @@ public:
     float get_specular() const;
     float get_sp() const;
     Color get_background() const;
+    RenderSettings const& get_settings() const;
 
-    void add_shape(std::unique_ptr<Shape>&& shape);
+    void set_settings(RenderSettings const& settings);
 
-    template <typename T, typename... Args>
-    void add_shape(Args&&... args); // convenience function to avoid `std::make_unique`
-    
     void add_light(std::unique_ptr<Light>&& light);
 
     template <typename T, typename... Args>
@@ -112,8 +388,208 @@ public:
      * ......
      * ```
      * gives the correct look.
+     * @param stats If not null, filled with the render time, the time
+     * taken by each tile (or each row, with `RenderSchedule::Rows`), and,
+     * when compiled with `RAYTRACER_STATS`, ray counters of all threads
+     * @param cancel If not null, checked before each tile (or row); once
+     * set, the remaining pixels are left black and the render returns early
+     */
+    virtual std::vector<Color> render(int width, int height, RenderStats* stats = nullptr,
+        CancelToken const* cancel = nullptr) const = 0;
+
+    /**
+     * @brief Render the scene in passes, each with its own jitter within
+     * the pixels and its own samples (see `Sampler::pass`), and return the
+     * mean of the passes, laid out like `render()`'s. Pass 0 is the same as
+     * `render()`. Each tile takes passes until it converges or the render
+     * runs out of time, as `progressive` says.
+     * @param on_pass If set, called after each pass with the image so far
+     * @param stats If not null, filled in as by `render()`, summed over
+     * the passes
+     * @param cancel If not null, checked before each tile, as by
+     * `render()`, unless `progressive` has a time budget; then it is only
+     * checked between passes
+     */
+    std::vector<Color> render_progressive(int width, int height, ProgressiveSettings const& progressive,
+        std::function<void(ProgressiveFrame const&)> const& on_pass = nullptr,
+        RenderStats* stats = nullptr, CancelToken const* cancel = nullptr) const;
+
+    /**
+     * @brief Render the scene like `render()`, and also fill in the output
+     * variables `aovs.settings` asks for, resized to the image. Each takes
+     * its pixels from the primary ray through their center; pixels outside
+     * `settings.region` hit nothing.
+     * @param stats If not null, filled in as by `render()`
+     * @param cancel If not null, checked as by `render()`
+     */
+    std::vector<Color> render_aovs(int width, int height, AOVBuffers& aovs, RenderStats* stats = nullptr,
+        CancelToken const* cancel = nullptr) const;
+
+    /**
+     * @brief Find the closest hit of every active lane of `packet`, and
+     * store it in `hit`, which should be freshly constructed.
+     */
+    virtual void intersect_packet(RayPacket const& packet, PacketHit& hit) const = 0;
+
+    /**
+     * @brief Bring acceleration structures up to date with the shapes.
+     * Called at the start of every render; must not be called concurrently
+     * with any query on the scene.
+     */
+    virtual void update_bvh() const = 0;
+
+    /**
+     * @brief Check whether anything blocks a ray before it reaches `t_max`.
+     * Unlike finding the closest intersection, returns as soon as any
+     * blocker is found, which is all shadow rays need.
+     * @param ray The ray
+     * @param t_max Only intersections with `0 < t < t_max` count
+     */
+    virtual bool occluded(Ray const& ray, float t_max) const = 0;
+
+    /**
+     * @param recursion_depth maximum recursion depth allowed; 0 for no recursion
+     * @param weight how much the color contributes to the pixel, passed on
+     * to the material (see `Material::get_color()`)
+     */
+    virtual Color trace(Ray const& ray, int recursion_depth, float weight = 1.0f) const = 0;
+
+    /**
+     * @brief Decide whether to trace a secondary ray of the given weight,
+     * as `settings.min_weight` and `settings.russian_roulette` say.
+     * @return 0 if the ray should not be traced; otherwise the factor to
+     * multiply both its color and its weight by (1 unless it survived
+     * Russian roulette). The roulette only depends on the pixel, the pass,
+     * `recursion_depth` (that of the hit the ray leaves) and `weight`, so
+     * the same scene always renders the same image, whatever the threads.
+     */
+    float path_scale(float weight, int recursion_depth) const;
+
+    /**
+     * @brief Trace a secondary ray on behalf of a material, i.e.,
+     * `factor * trace(ray, recursion_depth, weight)`. Unless
+     * `settings.integrator` is `Integrator::Recursive`, the ray is usually
+     * queued instead and black is returned; its color is added to the pixel
+     * later. Materials should send every secondary ray through here, and
+     * only call `trace()` directly with a recursion depth of 0.
+     * @param factor What the material multiplies the ray's color by
+     * @param weight Weight of the ray itself (see `trace()`)
+     */
+    Color trace_secondary(Ray const& ray, int recursion_depth, Color const& factor, float weight) const;
+    Color trace_secondary(Ray const& ray, int recursion_depth, float factor, float weight) const;
+
+    // Whether `trace_secondary()` would queue a ray rather than trace it
+    bool queues_secondary() const;
+
+    /**
+     * @brief Radiance arriving along a sample ray, i.e., `trace(ray, 0,
+     * weight)`, but looked up in the radiance cache when
+     * `settings.radiance_cache` enables it. Counts the reflection rays it
+     * traces.
+     * @param normal Unit normal of the surface the ray leaves
      */
-    std::vector<Color> render(int width, int height) const;
+    Color sample_radiance(Ray const& ray, Vector const& normal, float weight) const;
+
+    /**
+     * @brief Check whether a light illuminates a point on a surface, i.e.,
+     * that it lies on the side `normal` points to and is not occluded.
+     * The shadow ray is only traced when the first condition holds.
+     */
+    bool is_light_visible(Light const& light, Point const& point, Vector const& normal) const;
+
+    /**
+     * @brief Call `func(light)` with a `Light const&` for every light source
+     * visible from `point` (see `is_light_visible()`), without allocating.
+     * @param point The point, usually offset slightly from the surface
+     * @param normal Unit normal of the surface on the side being shaded
+     * @param func The callback
+     */
+    template <typename Func>
+    void for_each_visible_light(Point const& point, Vector const& normal, Func&& func) const;
+};
+
+/**
+ * @brief What `Scene` and `StaticScene` have in common, written once for
+ * the concrete scene type `Derived` (which derives from
+ * `SceneImpl<Derived>`), so that the render loop and the functions
+ * materials call back into reach `Derived::trace()`, `Derived::shade()`
+ * and `Derived::occluded()` without virtual calls.
+ *
+ * `Derived` provides `trace()`, `occluded()`, `intersect_packet()`,
+ * `update_bvh()`, and `shade(ray, t, shape, recursion_depth, weight)`,
+ * the color seen along `ray`, which first hits `shape` at `t` (or nothing
+ * if `shape` is null).
+ */
+template <typename Derived>
+class SceneImpl : public SceneBase {
+protected:
+    Derived const& derived() const;
+
+    // Color of the pixel at row `i`, column `j`
+    Color render_pixel(RayGenerator const& rays, int i, int j, GBuffer* gbuffer) const;
+    // Render pixels `j` to `j + count - 1` of row `i` as a single packet
+    void render_packet(RayGenerator const& rays, int i, int j, int count, Color* output, GBuffer* gbuffer) const;
+
+    void render_span(RayGenerator const& rays, int i, int x0, int x1, Color* output, GBuffer* gbuffer) const override;
+    Color shade_hit(Ray const& ray, float t, Shape const* shape, int recursion_depth) const override;
+
+public:
+    using SceneBase::SceneBase;
+
+    std::vector<Color> render(int width, int height, RenderStats* stats = nullptr,
+        CancelToken const* cancel = nullptr) const override;
+
+    // Same as in `SceneBase`, but calling `Derived::trace()` directly
+    Color trace_secondary(Ray const& ray, int recursion_depth, Color const& factor, float weight) const;
+    Color trace_secondary(Ray const& ray, int recursion_depth, float factor, float weight) const;
+    Color sample_radiance(Ray const& ray, Vector const& normal, float weight) const;
+
+    // Same as in `SceneBase`, but calling `Derived::occluded()` directly
+    bool is_light_visible(Light const& light, Point const& point, Vector const& normal) const;
+
+    template <typename Func>
+    void for_each_visible_light(Point const& point, Vector const& normal, Func&& func) const;
+};
+
+/**
+ * @brief A scene holding any kind of shapes, added at run time.
+ */
+class Scene final : public SceneImpl<Scene> {
+private:
+    std::vector<std::unique_ptr<Shape>> shapes;
+
+    // Geometry of spheres and planes, copied out of `shapes`; other shapes
+    // go through their virtual functions
+    mutable PrimitiveStore primitives;
+    // Non-owning views of the other shapes, split by whether they have bounds
+    std::vector<Shape const*> bounded; // indexed by `bvh`
+    std::vector<Shape const*> unbounded; // tested against every ray
+    // Built lazily by `update_bvh()`, hence mutable
+    mutable BVH bvh;
+    mutable bool bvh_dirty = false;
+
+    // See `SceneImpl`
+    Color shade(Ray const& ray, float t, Shape const* shape, int recursion_depth, float weight) const;
+
+    friend class SceneBase; // for `render_wavefront()`
+    friend class SceneImpl<Scene>; // for `shade()`
+
+public:
+    using SceneImpl::SceneImpl;
+
+    void add_shape(std::unique_ptr<Shape>&& shape);
+
+    template <typename T, typename... Args>
+    void add_shape(Args&&... args); // convenience function to avoid `std::make_unique`
+
+    /**
+     * @brief Rebuild the BVHs (and lay out the sphere arrays to match)
+     * if shapes were added since the last build.
+     * Called at the start of `render()`, so the BVH is built once and
+     * reused by every following frame. Must not be called concurrently
+     * with any query on the scene.
+     */
+    void update_bvh() const override;
 
     /**
      * @brief Compute the first point a ray intersects among all shapes
@@ -125,14 +601,15 @@ public:
     std::optional<std::pair<float, std::reference_wrapper<Shape const>>> intersect_first_all(Ray const& ray) const;
 
     /**
-     * @brief Get all point light sources visible from `point`.
+     * @brief Packet version of `intersect_first_all()`: the closest
+     * intersection of every active lane is stored in `hit`, which should
+     * be freshly constructed.
      */
-    std::vector<std::reference_wrapper<Light const>> get_visible_point_lights(Point const& point) const;
+    void intersect_packet(RayPacket const& packet, PacketHit& hit) const override;
 
-    /**
-     * @param recursion_depth maximum recursion depth allowed; 0 for no recursion
-     */
-    Color trace(Ray const& ray, int recursion_depth) const;
+    bool occluded(Ray const& ray, float t_max) const override;
+
+    Color trace(Ray const& ray, int recursion_depth, float weight = 1.0f) const override;
 };
 
 template <typename T, typename... Args>
@@ -141,6 +618,262 @@ inline void Scene::add_shape(Args&&... args) {
 }
 
 template <typename T, typename... Args>
-inline void Scene::add_light(Args&&... args) {
+inline void SceneBase::add_light(Args&&... args) {
     this->add_light(std::make_unique<T>(args...));
 }
+
+template <typename Func>
+inline void SceneBase::for_each_visible_light(Point const& point, Vector const& normal, Func&& func) const {
+    for_each_visible_light_in(*this, point, normal, func);
+}
+
+template <typename SceneT, typename Func>
+inline void SceneBase::for_each_visible_light_in(SceneT const& scene, Point const& point, Vector const& normal, Func&& func) {
+    for (auto&& light : scene.lights) {
+        if (is_light_visible_in(scene, *light, point, normal)) {
+            func(*light);
+        }
+    }
+}
+
+template <typename SceneT>
+inline bool SceneBase::is_light_visible_in(SceneT const& scene, Light const& light, Point const& point, Vector const& normal) {
+    // A light behind the surface cannot contribute, so don't bother
+    // tracing a shadow ray towards it
+    if (light.get_direction(point) * normal <= 0) {
+        return false;
+    }
+    STATS_ADD(shadow_rays, 1);
+    // The light is at `t = 1` along its shadow ray
+    return !scene.occluded(light.shadow_ray(point), 1.0f);
+}
+
+inline float SceneBase::path_scale(float weight, int recursion_depth) const {
+    // Most rays are well above the threshold, so the rest is out of line
+    if (weight >= this->settings.min_weight) {
+        return 1.0f;
+    }
+    return this->prune(weight, recursion_depth);
+}
+
+inline Color SceneBase::trace_secondary(Ray const& ray, int recursion_depth, Color const& factor, float weight) const {
+    return trace_secondary_in(*this, ray, recursion_depth, factor, weight);
+}
+
+template <typename SceneT>
+inline Color SceneBase::trace_secondary_in(SceneT const& scene, Ray const& ray, int recursion_depth, Color const& factor, float weight) {
+    if (RayTree* tree = RayTree::active; tree && tree->defers()) {
+        return tree->defer(ray, recursion_depth, factor, weight);
+    }
+    return factor * scene.trace(ray, recursion_depth, weight);
+}
+
+inline Color SceneBase::trace_secondary(Ray const& ray, int recursion_depth, float factor, float weight) const {
+    return this->trace_secondary(ray, recursion_depth, Color::raw(factor, factor, factor), weight);
+}
+
+inline Color SceneBase::sample_radiance(Ray const& ray, Vector const& normal, float weight) const {
+    return sample_radiance_in(*this, ray, normal, weight);
+}
+
+template <typename SceneT>
+inline Color SceneBase::sample_radiance_in(SceneT const& scene, Ray const& ray, Vector const& normal, float weight) {
+    if (!scene.settings.radiance_cache.enabled) {
+        STATS_ADD(reflection_rays, 1);
+        return scene.trace(ray, 0, weight);
+    }
+    return scene.cached_radiance(ray, normal, weight);
+}
+
+inline bool SceneBase::queues_secondary() const {
+    RayTree const* tree = RayTree::active;
+    return tree && tree->defers();
+}
+
+template <typename SceneT>
+inline void SceneBase::render_wavefront(SceneT const& scene, RayGenerator const& rays, int i, int x0, int x1, Color* output,
+    GBuffer* gbuffer) const {
+    // Reused by every row the thread renders
+    thread_local RayTree tree;
+    thread_local std::vector<int> order; // nodes of the current generation, by octant
+    thread_local std::vector<std::pair<float, Shape const*>> hits; // indexed like the generation
+    thread_local std::vector<std::type_info const*> types; // of the shapes hit, null for none
+    thread_local std::vector<int> bin_of; // index in `types`, indexed like the generation
+    thread_local std::vector<int> bin_starts; // where each bin starts in `bins`
+    thread_local std::vector<int> bins; // nodes of the current generation, by material
+    tree.clear(this->settings.ray_budget);
+    for (int j = x0; j < x1; j++) {
+        STATS_ADD(primary_rays, 1);
+        tree.add_root(rays.ray(i, j), this->recursion_depth, Sampler::pixel_id(i, j));
+    }
+    RayTree::active = &tree;
+    // The children of each generation are added right after it
+    for (int begin = 0, end = tree.nodes.size(); begin < end; begin = end, end = tree.nodes.size()) {
+        // Rays going into the same octant traverse the BVH in about the same
+        // order, so they make for better packets. Counting sort, which keeps
+        // primary rays in pixel order.
+        auto octant = [&](int n) {
+            Vector const& d = tree.nodes[n].ray.direction;
+            return (d.x < 0) | (d.y < 0) << 1 | (d.z < 0) << 2;
+        };
+        int starts[9] = {};
+        for (int n = begin; n < end; n++) {
+            starts[octant(n) + 1]++;
+        }
+        std::partial_sum(starts, starts + 9, starts);
+        order.resize(end - begin);
+        for (int n = begin; n < end; n++) {
+            order[starts[octant(n)]++] = n;
+        }
+
+        hits.resize(end - begin);
+        for (std::size_t k = 0; k < order.size(); k += kPacketSize) {
+            int count = std::min<std::size_t>(kPacketSize, order.size() - k);
+            RayPacket packet;
+            for (int l = 0; l < count; l++) {
+                packet.set(l, tree.nodes[order[k + l]].ray);
+            }
+            PacketHit hit;
+            scene.intersect_packet(packet, hit);
+            for (int l = 0; l < count; l++) {
+                hits[order[k + l] - begin] = { hit.t[l], hit.shape[l] };
+            }
+        }
+
+        // Shapes of the same type run the same material code. Scenes hold
+        // a handful of types, so a linear search and a counting sort beat
+        // sorting by the shape itself, which cost more than it saved.
+        types.clear();
+        bin_of.resize(end - begin);
+        bin_starts.assign(1, 0);
+        for (int n = begin; n < end; n++) {
+            Shape const* shape = hits[n - begin].second;
+            std::type_info const* type = shape ? &typeid(*shape) : nullptr;
+            int bin = std::find(types.begin(), types.end(), type) - types.begin();
+            if (bin == (int)types.size()) {
+                types.push_back(type);
+                bin_starts.push_back(0);
+            }
+            bin_of[n - begin] = bin;
+            bin_starts[bin + 1]++;
+        }
+        std::partial_sum(bin_starts.begin(), bin_starts.end(), bin_starts.begin());
+        bins.resize(end - begin);
+        for (int n = begin; n < end; n++) {
+            bins[bin_starts[bin_of[n - begin]]++] = n;
+        }
+        for (int n : bins) {
+            tree.begin(n);
+            // The node is invalidated as children are added
+            RayTree::Node node = tree.nodes[n];
+            auto [t, shape] = hits[n - begin];
+            // The first generation holds the primary rays, in pixel order
+            if (begin == 0) {
+                GBuffer::begin(gbuffer, i, x0 + n);
+            }
+            tree.nodes[n].color = scene.shade(node.ray, t, shape, node.depth, node.weight);
+            GBuffer::active = nullptr;
+        }
+    }
+    RayTree::active = nullptr;
+    tree.resolve();
+    for (int j = x0; j < x1; j++) {
+        Color color = tree.nodes[j - x0].color;
+        GBuffer::record_radiance(gbuffer, i, j, color);
+        color.clamp();
+        output[j] = color;
+    }
+}
+
+template <typename Derived>
+inline Derived const& SceneImpl<Derived>::derived() const {
+    return static_cast<Derived const&>(*this);
+}
+
+template <typename Derived>
+inline Color SceneImpl<Derived>::render_pixel(RayGenerator const& rays, int i, int j, GBuffer* gbuffer) const {
+    STATS_ADD(primary_rays, 1);
+    Sampler::pixel = Sampler::pixel_id(i, j);
+    GBuffer::begin(gbuffer, i, j);
+    Color color = this->derived().trace(rays.ray(i, j), this->recursion_depth);
+    GBuffer::active = nullptr;
+    GBuffer::record_radiance(gbuffer, i, j, color);
+    color.clamp();
+    return color;
+}
+
+template <typename Derived>
+inline void SceneImpl<Derived>::render_packet(RayGenerator const& rays, int i, int j, int count, Color* output,
+    GBuffer* gbuffer) const {
+    RayPacket packet;
+    rays.packet(i, j, count, packet);
+    PacketHit hit;
+    this->derived().intersect_packet(packet, hit);
+    // Shading diverges right away (different materials, secondary rays),
+    // so it's done one ray at a time
+    for (int k = 0; k < count; k++) {
+        STATS_ADD(primary_rays, 1);
+        Sampler::pixel = Sampler::pixel_id(i, j + k);
+        GBuffer::begin(gbuffer, i, j + k);
+        Color color = this->derived().shade(packet.ray(k), hit.t[k], hit.shape[k], this->recursion_depth, 1.0f);
+        GBuffer::active = nullptr;
+        GBuffer::record_radiance(gbuffer, i, j + k, color);
+        color.clamp();
+        output[k] = color;
+    }
+}
+
+template <typename Derived>
+inline void SceneImpl<Derived>::render_span(RayGenerator const& rays, int i, int x0, int x1, Color* output,
+    GBuffer* gbuffer) const {
+    if (this->settings.integrator == Integrator::Iterative) {
+        this->render_iterative(rays, i, x0, x1, output, gbuffer);
+    } else if (this->settings.integrator == Integrator::Wavefront) {
+        this->render_wavefront(this->derived(), rays, i, x0, x1, output, gbuffer);
+    } else if (this->settings.packets) {
+        for (int j = x0; j < x1; j += kPacketSize) {
+            this->render_packet(rays, i, j, std::min(kPacketSize, x1 - j), &output[j], gbuffer);
+        }
+    } else {
+        for (int j = x0; j < x1; j++) {
+            output[j] = this->render_pixel(rays, i, j, gbuffer);
+        }
+    }
+}
+
+template <typename Derived>
+inline Color SceneImpl<Derived>::shade_hit(Ray const& ray, float t, Shape const* shape, int recursion_depth) const {
+    return this->derived().shade(ray, t, shape, recursion_depth, 1.0f);
+}
+
+template <typename Derived>
+inline std::vector<Color> SceneImpl<Derived>::render(int width, int height, RenderStats* stats, CancelToken const* cancel) const {
+    this->derived().update_bvh();
+    return this->render_rows(width, height, stats, cancel);
+}
+
+template <typename Derived>
+inline Color SceneImpl<Derived>::trace_secondary(Ray const& ray, int recursion_depth, Color const& factor, float weight) const {
+    return trace_secondary_in(this->derived(), ray, recursion_depth, factor, weight);
+}
+
+template <typename Derived>
+inline Color SceneImpl<Derived>::trace_secondary(Ray const& ray, int recursion_depth, float factor, float weight) const {
+    return trace_secondary_in(this->derived(), ray, recursion_depth, Color::raw(factor, factor, factor), weight);
+}
+
+template <typename Derived>
+inline Color SceneImpl<Derived>::sample_radiance(Ray const& ray, Vector const& normal, float weight) const {
+    return sample_radiance_in(this->derived(), ray, normal, weight);
+}
+
+template <typename Derived>
+inline bool SceneImpl<Derived>::is_light_visible(Light const& light, Point const& point, Vector const& normal) const {
+    return is_light_visible_in(this->derived(), light, point, normal);
+}
+
+template <typename Derived>
+template <typename Func>
+inline void SceneImpl<Derived>::for_each_visible_light(Point const& point, Vector const& normal, Func&& func) const {
+    for_each_visible_light_in(this->derived(), point, normal, func);
+}
@@ -9,6 +9,7 @@
 #include "shape.hpp"
 #include "shapes/plane.hpp"
 #include "shapes/sphere.hpp"
+#include "static_scene.hpp"
 #include "ui.hpp"
 #include "vector.hpp"
 
@@ -36,19 +37,27 @@ Scene scene(Camera& camera, Screen& screen, float ambient = 0.8f, float specular
     return Scene(&camera, &screen, ambient, specular, sp, background);
 }
 
+// Same as `scene()`, for a `StaticScene` holding the given shape types, e.g.,
+// `static_scene<BasicSphere<>, BasicPlane<>>(camera, screen)`
+template <typename... Shapes>
+StaticScene<Shapes...> static_scene(Camera& camera, Screen& screen, float ambient = 0.8f, float specular = 0.5f, float sp = 8.0f, Color background = rgb(135, 206, 235)) {
+    return StaticScene<Shapes...>(&camera, &screen, ambient, specular, sp, background);
+}
+
 // Convenience function to create a screen with specified width and height
 Screen screen(float width = 10.0f, float height = 10.0f) {
     return Screen(width, height);
 }
 
 // Convenience function to create a basic sphere shape
-template <typename T>
-void sphere(Point center, float radius, T material, Scene& scene) {
-    scene.add_shape<BasicSphere<T>>(center, radius, material);
+// (works with both `Scene` and `StaticScene`)
+template <typename T, typename SceneT>
+void sphere(Point center, float radius, T material, SceneT& scene) {
+    scene.template add_shape<BasicSphere<T>>(center, radius, material);
 }
 
 // Convenience function to create a basic plane shape
-template <typename T>
-void plane(Point point, Vector normal, T material, Scene& scene) {
-    scene.add_shape<BasicPlane<T>>(point, normal, material);
+template <typename T, typename SceneT>
+void plane(Point point, Vector normal, T material, SceneT& scene) {
+    scene.template add_shape<BasicPlane<T>>(point, normal, material);
 }
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "scheduler.hpp"
+
+void CancelToken::cancel() {
+    this->cancelled.store(true, std::memory_order_relaxed);
+}
+
+void CancelToken::cancel_at(std::chrono::steady_clock::time_point deadline) {
+    this->deadline.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void CancelToken::reset() {
+    this->cancelled.store(false, std::memory_order_relaxed);
+    this->deadline.store(std::chrono::steady_clock::time_point::max().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool CancelToken::is_cancelled() const {
+    if (this->cancelled.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    auto deadline = this->deadline.load(std::memory_order_relaxed);
+    // Only read the clock when there is a deadline
+    return deadline != std::chrono::steady_clock::time_point::max().time_since_epoch().count()
+        && std::chrono::steady_clock::now().time_since_epoch().count() >= deadline;
+}
+
+// Interleave the bits of x and y (x in the even bits)
+uint64_t morton_code(uint32_t x, uint32_t y) {
+    auto spread = [](uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+// Distance of (x, y) along the Hilbert curve filling an n x n grid,
+// where n is a power of two
+// https://en.wikipedia.org/wiki/Hilbert_curve#Applications_and_mapping_algorithms
+uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+TileScheduler::TileScheduler(int width, int height, int tile_size, TileOrder order)
+    : TileScheduler(Tile { 0, 0, width, height }, tile_size, order) {
+}
+
+TileScheduler::TileScheduler(Tile region, int tile_size, TileOrder order) {
+    tile_size = std::max(1, tile_size);
+    int width = std::max(0, region.x1 - region.x0);
+    int height = std::max(0, region.y1 - region.y0);
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+    uint32_t n = 1; // side of the smallest power-of-two grid containing all tiles
+    while (n < (uint32_t)std::max(tiles_x, tiles_y)) {
+        n *= 2;
+    }
+
+    // Pair each tile with its position along the curve
+    std::vector<std::pair<uint64_t, Tile>> keyed;
+    keyed.reserve(tiles_x * tiles_y);
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            Tile tile { region.x0 + tx * tile_size, region.y0 + ty * tile_size,
+                region.x0 + std::min(width, (tx + 1) * tile_size), region.y0 + std::min(height, (ty + 1) * tile_size) };
+            uint64_t key;
+            switch (order) {
+                case TileOrder::Morton:
+                    key = morton_code(tx, ty);
+                    break;
+                case TileOrder::Hilbert:
+                    key = hilbert_index(n, tx, ty);
+                    break;
+                default:
+                    key = (uint64_t)ty * tiles_x + tx;
+                    break;
+            }
+            keyed.emplace_back(key, tile);
+        }
+    }
+    std::stable_sort(keyed.begin(), keyed.end(), [](auto const& a, auto const& b) {
+        return a.first < b.first;
+    });
+
+    this->tiles.reserve(keyed.size());
+    for (auto&& [key, tile] : keyed) {
+        this->tiles.push_back(tile);
+    }
+}
+
+TileScheduler::TileScheduler(std::vector<Tile> tiles)
+    : tiles(std::move(tiles)) {
+}
+
+std::vector<Tile> const& TileScheduler::get_tiles() const {
+    return this->tiles;
+}
+
+std::optional<int> TileScheduler::WorkQueue::pop_front() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->tiles.empty()) {
+        return {};
+    }
+    int tile = this->tiles.front();
+    this->tiles.pop_front();
+    return tile;
+}
+
+std::optional<int> TileScheduler::WorkQueue::steal_back() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->tiles.empty()) {
+        return {};
+    }
+    int tile = this->tiles.back();
+    this->tiles.pop_back();
+    return tile;
+}
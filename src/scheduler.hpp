@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <omp.h>
+
+/**
+ * @brief A rectangle of pixels `[x0, x1) x [y0, y1)`, where `x` is the
+ * column and `y` is the row.
+ */
+struct Tile {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+/**
+ * @brief How long a tile took to render, and on which thread.
+ */
+struct TileTiming {
+    Tile tile;
+    int thread;
+    double milliseconds;
+};
+
+/**
+ * @brief Flag for asking a running render to stop early. Set from any
+ * thread; checked by the render before each tile (or row).
+ */
+class CancelToken {
+private:
+    std::atomic<bool> cancelled { false };
+    // In `steady_clock` ticks; none by default
+    std::atomic<std::chrono::steady_clock::rep> deadline { std::chrono::steady_clock::time_point::max().time_since_epoch().count() };
+
+public:
+    void cancel();
+    // Also count as cancelled from `deadline` on
+    void cancel_at(std::chrono::steady_clock::time_point deadline);
+    void reset(); // clears the deadline too
+    bool is_cancelled() const;
+};
+
+/**
+ * @brief Order in which tiles are handed out. Space-filling curves keep
+ * consecutive tiles (and so the tiles of a thread) close to each other.
+ */
+enum class TileOrder {
+    Scanline, // row by row
+    Morton, // Z-order curve
+    Hilbert // Hilbert curve; better locality than Morton
+};
+
+/**
+ * @brief Splits an image into tiles and renders them in parallel on OpenMP
+ * threads. Each thread starts with a contiguous run of tiles along the
+ * chosen curve in its own deque, takes work from the front, and steals
+ * from the back of the other deques when it runs out.
+ */
+class TileScheduler {
+private:
+    std::vector<Tile> tiles; // in the order given by `TileOrder`
+
+    // Deque of tile indices owned by one thread, guarded by a mutex;
+    // padded so that deques of different threads don't share a cache line
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+
+        std::optional<int> pop_front();
+        std::optional<int> steal_back();
+    };
+
+public:
+    TileScheduler(int width, int height, int tile_size, TileOrder order);
+    // Only split `region` of the image into tiles
+    TileScheduler(Tile region, int tile_size, TileOrder order);
+    // Render exactly these tiles, in this order
+    explicit TileScheduler(std::vector<Tile> tiles);
+
+    std::vector<Tile> const& get_tiles() const;
+
+    /**
+     * @brief Call `func(tile)` for every tile, in parallel.
+     * @param func The callback
+     * @param cancel If not null, no more tiles are started once it is set
+     * @return The time taken by each tile, in the order they finished
+     * on each thread (grouped by thread).
+     */
+    template <typename Func>
+    std::vector<TileTiming> run(Func&& func, CancelToken const* cancel = nullptr) const;
+};
+
+// Template definition; must be put or otherwise included in the header
+
+template <typename Func>
+std::vector<TileTiming> TileScheduler::run(Func&& func, CancelToken const* cancel) const {
+    int num_threads = omp_get_max_threads();
+    std::vector<WorkQueue> queues(num_threads);
+    // Deal out contiguous runs of tiles, so each thread starts on its own
+    // region of the image
+    int num_tiles = this->tiles.size();
+    for (int t = 0; t < num_threads; t++) {
+        int begin = (long long)num_tiles * t / num_threads;
+        int end = (long long)num_tiles * (t + 1) / num_threads;
+        for (int i = begin; i < end; i++) {
+            queues[t].tiles.push_back(i);
+        }
+    }
+
+    std::vector<std::vector<TileTiming>> timings(num_threads);
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int thread = omp_get_thread_num();
+        while (!(cancel && cancel->is_cancelled())) {
+            std::optional<int> next = queues[thread].pop_front();
+            // Out of work, so try to steal from the others
+            for (int k = 1; !next && k < num_threads; k++) {
+                next = queues[(thread + k) % num_threads].steal_back();
+            }
+            if (!next) {
+                // No work is ever added, so every queue stays empty from now on
+                break;
+            }
+            Tile const& tile = this->tiles[next.value()];
+            auto start_time = std::chrono::steady_clock::now();
+            func(tile);
+            auto end_time = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+            timings[thread].push_back(TileTiming { tile, thread, ms });
+        }
+    }
+
+    std::vector<TileTiming> result;
+    result.reserve(num_tiles);
+    for (auto&& thread_timings : timings) {
+        result.insert(result.end(), thread_timings.begin(), thread_timings.end());
+    }
+    return result;
+}
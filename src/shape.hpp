@@ -1,26 +1,55 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <memory>
 #include <optional>
 
+#include "aabb.hpp"
 #include "color.hpp"
 #include "material.hpp"
+#include "packet.hpp"
 #include "ray.hpp"
 #include "vector.hpp"
 
 // Forward declaration
 class Material;
+class MaterialStorage;
 class BasicMaterial;
 
+/**
+ * @brief Which of the scene's primitive arrays (see `PrimitiveStore`) a
+ * shape's geometry is copied into.
+ */
+enum class PrimitiveKind {
+    Custom, // not copied; intersected through the virtual functions below
+    Sphere,
+    Plane,
+};
+
 /**
  * Represents a shape that can be rendered.
  * All shapes are assumed to be double-sided.
  */
 class Shape {
+private:
+    uint32_t id = 0; // see `get_id()`
+
+    // Assign `id` when shapes are added
+    friend class Scene;
+    template <typename... Shapes>
+    friend class StaticScene;
+
 public:
     virtual ~Shape() { };
 
+    /**
+     * @return Which shape of its scene this is: 1 for the first one added,
+     * 2 for the second, and so on, whatever the scene does with them
+     * afterwards; 0 if it isn't in a scene.
+     */
+    uint32_t get_id() const;
+
     /**
      * @return The smallest positive parameter `t` among the intersections
      * if it exists, and empty otherwise. When it exists, the
@@ -30,6 +59,37 @@ public:
      */
     virtual std::optional<float> intersect_first(Ray const&) const = 0;
 
+    /**
+     * @return Whether the ray intersects the shape at some parameter `t`
+     * with `0 < t < t_max`. Used for shadow rays, where any intersection
+     * will do; the default implementation falls back to `intersect_first()`.
+     */
+    virtual bool intersects_any(Ray const& ray, float t_max) const;
+
+    /**
+     * @brief Packet version of `intersect_first()`: for every active lane
+     * that hits the shape closer than `hit.t`, set `hit.t` to the new
+     * parameter and `hit.shape` to this shape. The default implementation
+     * intersects the lanes one at a time.
+     */
+    virtual void intersect_packet(RayPacket const& packet, PacketHit& hit) const;
+
+    /**
+     * @return A box containing the whole shape, or empty if the shape is
+     * unbounded. Bounded shapes are put into the scene's BVH; unbounded
+     * ones are tested against every ray.
+     */
+    virtual std::optional<AABB> bounds() const;
+
+    /**
+     * @return `PrimitiveKind::Custom` unless the scene may intersect the
+     * shape through its own copy of the geometry, bypassing
+     * `intersect_first()` and the other intersection functions. Only
+     * overridden by shapes whose intersection is known to be unchanged
+     * (e.g., `BasicSphere`, but not other subclasses of `Sphere`).
+     */
+    virtual PrimitiveKind primitive_kind() const;
+
     /**
      * @return A unit normal vector at the given point on the surface.
      * The direction is guaranteed to point out of the object whenever
@@ -43,7 +103,40 @@ public:
 
     /**
      * @return The material at the given point on the surface. Ownership is
-     * transferred.
+     * not transferred: shapes with a fixed material return a reference to
+     * it, and shapes that compute materials on the fly construct them in
+     * `storage`. The reference is valid as long as both the shape and
+     * `storage` are alive and `storage` is not reused.
      */
-    virtual std::unique_ptr<Material> material_at(Point const&) const = 0;
+    virtual Material const& material_at(Point const& point, MaterialStorage& storage) const = 0;
 };
+
+inline uint32_t Shape::get_id() const {
+    return this->id;
+}
+
+inline bool Shape::intersects_any(Ray const& ray, float t_max) const {
+    std::optional<float> t = this->intersect_first(ray);
+    return t && t.value() < t_max;
+}
+
+inline void Shape::intersect_packet(RayPacket const& packet, PacketHit& hit) const {
+    for (int k = 0; k < kPacketSize; k++) {
+        if (!packet.active[k]) {
+            continue;
+        }
+        std::optional<float> t = this->intersect_first(packet.ray(k));
+        if (t && t.value() < hit.t[k]) {
+            hit.t[k] = t.value();
+            hit.shape[k] = this;
+        }
+    }
+}
+
+inline std::optional<AABB> Shape::bounds() const {
+    return {};
+}
+
+inline PrimitiveKind Shape::primitive_kind() const {
+    return PrimitiveKind::Custom;
+}
@@ -4,16 +4,10 @@ Plane::Plane(Point point, Vector normal)
     : point(point)
     , normal(!normal) { }
 
-std::optional<float> Plane::intersect_first(Ray const& ray) const {
-    float div = ray.direction * this->normal;
-    if (std::abs(div) < 1e-6) {
-        return {};
-    }
-    // Use (point - origin) to keep the plane fixed in world space; sign matters
-    float t = ((this->point - ray.origin) * this->normal) / div;
-    return t > 0 ? std::optional<float>(t) : std::nullopt;
+Point Plane::get_point() const {
+    return this->point;
 }
 
-Vector Plane::normal_at(Point const&) const {
-    return normal;
-}
\ No newline at end of file
+Vector Plane::get_normal() const {
+    return this->normal;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cmath>
+#include <type_traits>
+
+#include "../primitives.hpp"
 #include "../shape.hpp"
 
 /**
@@ -12,10 +16,41 @@ protected:
 
 public:
     Plane(Point point, Vector normal);
+    Point get_point() const;
+    Vector get_normal() const;
     std::optional<float> intersect_first(Ray const&) const override;
+    void intersect_packet(RayPacket const& packet, PacketHit& hit) const override;
     Vector normal_at(Point const&) const override;
 };
 
+// Hot in intersection loops, so defined in the header to allow inlining
+
+inline std::optional<float> Plane::intersect_first(Ray const& ray) const {
+    float div = ray.direction * this->normal;
+    if (std::abs(div) < 1e-6) {
+        return {};
+    }
+    // Use (point - origin) to keep the plane fixed in world space; sign matters
+    float t = ((this->point - ray.origin) * this->normal) / div;
+    return t > 0 ? std::optional<float>(t) : std::nullopt;
+}
+
+inline void Plane::intersect_packet(RayPacket const& packet, PacketHit& hit) const {
+    PacketVector p = packet_broadcast(this->point) - packet.origin();
+    PacketFloat t {};
+    PacketMask hits = packet.active & plane_hits(p, packet.direction(), packet_broadcast(this->normal), t) & (t < hit.t);
+    hit.t = hits ? t : hit.t;
+    for (int k = 0; k < kPacketSize; k++) {
+        if (hits[k]) {
+            hit.shape[k] = this;
+        }
+    }
+}
+
+inline Vector Plane::normal_at(Point const&) const {
+    return normal;
+}
+
 /**
  * A plane with a single material.
  */
@@ -26,12 +61,15 @@ private:
 
 public:
     BasicPlane(Point point, Vector normal, T material);
-    std::unique_ptr<Material> material_at(Point const&) const override;
+    PrimitiveKind primitive_kind() const override;
+    T const& typed_material_at(Point const&) const; // `material_at()` without type erasure
+    Material const& material_at(Point const&, MaterialStorage&) const override;
 };
 
 /**
  * @brief A parametric plane on which material patterns can be added.
- * @tparam Func A function type `(float, float) -> std::unique_ptr<Material>`
+ * @tparam Func A function type `(float, float) -> T`, where `T` is a
+ * subclass of `Material` returned by value
  */
 template <typename Func>
 class ParametricPlane : public Plane {
@@ -43,7 +81,10 @@ private:
 
 public:
     ParametricPlane(Point point, Vector v, Vector w, Func material_fn);
-    std::unique_ptr<Material> material_at(Point const&) const override;
+    PrimitiveKind primitive_kind() const override;
+    // `material_at()` without type erasure; returns the material by value
+    std::invoke_result_t<Func, float, float> typed_material_at(Point const& point) const;
+    Material const& material_at(Point const&, MaterialStorage&) const override;
 };
 
 // Template definition; must be put or otherwise included in the header
@@ -55,8 +96,18 @@ inline BasicPlane<T>::BasicPlane(Point point, Vector normal, T material)
 }
 
 template <typename T>
-std::unique_ptr<Material> BasicPlane<T>::material_at(Point const&) const {
-    return std::make_unique<T>(this->material);
+inline PrimitiveKind BasicPlane<T>::primitive_kind() const {
+    return PrimitiveKind::Plane;
+}
+
+template <typename T>
+inline T const& BasicPlane<T>::typed_material_at(Point const&) const {
+    return this->material;
+}
+
+template <typename T>
+inline Material const& BasicPlane<T>::material_at(Point const&, MaterialStorage&) const {
+    return this->material;
 }
 
 template <typename Func>
@@ -68,10 +119,21 @@ inline ParametricPlane<Func>::ParametricPlane(Point point, Vector v, Vector w, F
 }
 
 template <typename Func>
-inline std::unique_ptr<Material> ParametricPlane<Func>::material_at(Point const& point) const {
+inline PrimitiveKind ParametricPlane<Func>::primitive_kind() const {
+    return PrimitiveKind::Plane;
+}
+
+template <typename Func>
+inline std::invoke_result_t<Func, float, float> ParametricPlane<Func>::typed_material_at(Point const& point) const {
     // Compute the parameters
     // solve for a v + b w + c n = (point - this->point), where n is the normal
     // a and b will be the parameters; c should theoretically be zero
     Vector param = lin_solve(this->v, this->w, this->normal, point - this->point);
     return this->material_fn(param.x, param.y);
 }
+
+template <typename Func>
+inline Material const& ParametricPlane<Func>::material_at(Point const& point, MaterialStorage& storage) const {
+    using T = std::invoke_result_t<Func, float, float>;
+    return storage.emplace<T>(this->typed_material_at(point));
+}
@@ -5,26 +5,15 @@ Sphere::Sphere(Point center, float radius)
     , radius(radius) {
 }
 
-std::optional<float> Sphere::intersect_first(Ray const& ray) const {
-    float a = ray.direction * ray.direction;
-    float b = 2 * ray.direction * (ray.origin - this->center);
-    float c = (ray.origin - this->center) * (ray.origin - this->center) - radius * radius;
-    float discriminant = b * b - 4 * a * c;
-    if (discriminant < 0) {
-        return {};
-    }
-    float root = std::sqrt(discriminant);
-    float t1 = (-b - root) / (2 * a);
-    float t2 = (-b + root) / (2 * a);
-    if (t1 > 0) {
-        return t1;
-    }
-    if (t2 > 0) {
-        return t2;
-    }
-    return {};
+Point Sphere::get_center() const {
+    return this->center;
 }
 
-Vector Sphere::normal_at(Point const& point) const {
-    return !(point - this->center);
-}
\ No newline at end of file
+float Sphere::get_radius() const {
+    return this->radius;
+}
+
+std::optional<AABB> Sphere::bounds() const {
+    Vector r(this->radius, this->radius, this->radius);
+    return AABB(this->center - r, this->center + r);
+}
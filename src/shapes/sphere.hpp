@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cmath>
+
+#include "../primitives.hpp"
 #include "../shape.hpp"
 
 /**
@@ -12,10 +15,71 @@ protected:
 
 public:
     Sphere(Point center, float radius);
+    Point get_center() const;
+    float get_radius() const;
     std::optional<float> intersect_first(Ray const&) const override;
+    bool intersects_any(Ray const& ray, float t_max) const override;
+    void intersect_packet(RayPacket const& packet, PacketHit& hit) const override;
+    std::optional<AABB> bounds() const override;
     Vector normal_at(Point const&) const override;
 };
 
+// Hot in intersection loops, so defined in the header to allow inlining
+
+inline std::optional<float> Sphere::intersect_first(Ray const& ray) const {
+    float a = ray.direction * ray.direction;
+    float b = 2 * ray.direction * (ray.origin - this->center);
+    float c = (ray.origin - this->center) * (ray.origin - this->center) - radius * radius;
+    float discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) {
+        return {};
+    }
+    float root = std::sqrt(discriminant);
+    float t1 = (-b - root) / (2 * a);
+    float t2 = (-b + root) / (2 * a);
+    if (t1 > 0) {
+        return t1;
+    }
+    if (t2 > 0) {
+        return t2;
+    }
+    return {};
+}
+
+inline bool Sphere::intersects_any(Ray const& ray, float t_max) const {
+    Vector oc = ray.origin - this->center;
+    float a = ray.direction * ray.direction;
+    float half_b = ray.direction * oc;
+    float c = oc * oc - radius * radius;
+    float discriminant = half_b * half_b - a * c;
+    if (discriminant < 0) {
+        return false;
+    }
+    // The roots are `a * t`, so compare them against `a * t_max` instead of dividing
+    float root = std::sqrt(discriminant);
+    float at1 = -half_b - root;
+    float at2 = -half_b + root;
+    float at_max = a * t_max;
+    return (at1 > 0 && at1 < at_max) || (at2 > 0 && at2 < at_max);
+}
+
+inline void Sphere::intersect_packet(RayPacket const& packet, PacketHit& hit) const {
+    PacketVector o = packet.origin() - packet_broadcast(this->center);
+    PacketFloat t {};
+    PacketMask hits = packet.active & sphere_hits(o, packet.direction(), packet_broadcast(this->radius * this->radius), t);
+    hits &= t < hit.t;
+    hit.t = hits ? t : hit.t;
+    for (int k = 0; k < kPacketSize; k++) {
+        if (hits[k]) {
+            hit.shape[k] = this;
+        }
+    }
+}
+
+inline Vector Sphere::normal_at(Point const& point) const {
+    return !(point - this->center);
+}
+
 // We use `BasicSphere<T: Material + Clone> { material: T }` instead of
 // `BasicSphere { material: Box<dyn (Material + Clone)> }`
 /**
@@ -28,7 +92,9 @@ private:
 
 public:
     BasicSphere(Point center, float radius, T material);
-    std::unique_ptr<Material> material_at(Point const&) const override;
+    PrimitiveKind primitive_kind() const override;
+    T const& typed_material_at(Point const&) const; // `material_at()` without type erasure
+    Material const& material_at(Point const&, MaterialStorage&) const override;
 };
 
 // Template definition; must be put or otherwise included in the header
@@ -40,6 +106,16 @@ inline BasicSphere<T>::BasicSphere(Point center, float radius, T material)
 }
 
 template <typename T>
-std::unique_ptr<Material> BasicSphere<T>::material_at(Point const&) const {
-    return std::make_unique<T>(this->material);
+inline PrimitiveKind BasicSphere<T>::primitive_kind() const {
+    return PrimitiveKind::Sphere;
+}
+
+template <typename T>
+inline T const& BasicSphere<T>::typed_material_at(Point const&) const {
+    return this->material;
+}
+
+template <typename T>
+inline Material const& BasicSphere<T>::material_at(Point const&, MaterialStorage&) const {
+    return this->material;
 }
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bvh.hpp"
+#include "primitives.hpp"
+#include "scene.hpp"
+
+/**
+ * @brief Whether a shape of type `ShapeT` has a `typed_material_at()` whose
+ * material has a `shade()` template callable with `SceneT`, so that
+ * `StaticScene` can shade it without going through `Material::get_color()`.
+ */
+template <typename ShapeT, typename SceneT, typename = void>
+struct has_typed_shading : std::false_type { };
+
+template <typename ShapeT, typename SceneT>
+struct has_typed_shading<ShapeT, SceneT,
+    std::void_t<decltype(std::declval<ShapeT const&>()
+                             .typed_material_at(std::declval<Point const&>())
+                             .shade(std::declval<Vector const&>(), std::declval<Point const&>(),
+                                 std::declval<Vector const&>(), std::declval<SceneT const&>(), 0, 1.0f))>>
+    : std::true_type { };
+
+/**
+ * @brief A scene whose shape types are fixed at compile time, for scenes
+ * that are known in advance (e.g., `StaticScene<BasicSphere<>, BasicPlane<>>`).
+ *
+ * Shapes are stored by value, one array per type, and every call on them
+ * names the concrete type, so intersection, normals and materials are
+ * resolved at compile time and can be inlined. Materials with a `shade()`
+ * template (all the materials in `materials/`) are called with this scene,
+ * so their shadow and secondary rays come back here without virtual calls
+ * either. Lights are still stored as `Light` pointers.
+ *
+ * Types whose `primitive_kind()` is not `PrimitiveKind::Custom` (basic
+ * spheres and planes) are intersected through a `PrimitiveStore`, like in
+ * `Scene`. Any other type whose shapes all have bounds gets its own BVH,
+ * and its array is laid out in the leaf order of that BVH; the remaining
+ * types are tested against every ray. Otherwise it behaves like `Scene`,
+ * and both can be passed to anything taking a `SceneBase`.
+ *
+ * @tparam Shapes Subclasses of `Shape`, each listed once
+ */
+template <typename... Shapes>
+class StaticScene final : public SceneImpl<StaticScene<Shapes...>> {
+    static_assert((std::is_base_of_v<Shape, Shapes> && ...), "StaticScene only holds shapes");
+
+private:
+    static constexpr std::size_t kTypes = sizeof...(Shapes);
+
+    template <std::size_t I>
+    using ShapeType = std::tuple_element_t<I, std::tuple<Shapes...>>;
+
+    // Reordered by `update_bvh()`, hence mutable
+    mutable std::tuple<std::vector<Shapes>...> shapes;
+    // Everything below is built lazily by `update_bvh()`, and only used
+    // while `bvh_dirty` is false. `stored[I]` is whether type `I` is in
+    // `primitives`, and `bounded[I]` whether it uses `bvhs[I]`.
+    mutable PrimitiveStore primitives;
+    mutable std::array<BVH, kTypes> bvhs;
+    mutable std::array<bool, kTypes> stored {};
+    mutable std::array<bool, kTypes> bounded {};
+    mutable bool bvh_dirty = false;
+
+    // Call `func(std::integral_constant<std::size_t, I>())` for every type index `I`
+    template <typename Func, std::size_t... I>
+    static void for_each_type(Func&& func, std::index_sequence<I...>);
+    // Same, but stop at the first call returning `true`, and return whether one did
+    template <typename Func, std::size_t... I>
+    static bool any_type(Func&& func, std::index_sequence<I...>);
+
+    // Call `visit(first, count)` for ranges of shapes of type `I` that the
+    // ray may hit, unless they are in `primitives`
+    template <std::size_t I, typename Func>
+    bool visit_shapes(Ray const& ray, float& t_max, Func&& visit) const;
+    template <std::size_t I, typename Func>
+    void visit_shapes(RayPacket const& packet, PacketFloat const& t_max, Func&& visit) const;
+
+    // See `SceneImpl`
+    Color shade(Ray const& ray, float t, Shape const* shape, int recursion_depth, float weight) const;
+
+    friend class SceneBase; // for `render_wavefront()`
+    friend class SceneImpl<StaticScene>; // for `shade()`
+
+public:
+    using SceneImpl<StaticScene>::SceneImpl;
+
+    template <typename T, typename... Args>
+    void add_shape(Args&&... args); // `T` must be one of `Shapes`
+
+    // Same as `Scene::update_bvh()`
+    void update_bvh() const override;
+
+    /**
+     * @brief Find the closest shape hit by the ray before `t_min`.
+     * @return The shape hit, with its parameter stored in `t_min`, or
+     * null (and `t_min` unchanged) if nothing is hit before `t_min`.
+     */
+    Shape const* intersect(Ray const& ray, float& t_min) const;
+
+    // Same as `Scene::intersect_packet()`
+    void intersect_packet(RayPacket const& packet, PacketHit& hit) const override;
+
+    bool occluded(Ray const& ray, float t_max) const override;
+
+    Color trace(Ray const& ray, int recursion_depth, float weight = 1.0f) const override;
+
+};
+
+// Template definition; must be put or otherwise included in the header
+
+template <typename... Shapes>
+template <typename Func, std::size_t... I>
+inline void StaticScene<Shapes...>::for_each_type(Func&& func, std::index_sequence<I...>) {
+    (func(std::integral_constant<std::size_t, I>()), ...);
+}
+
+template <typename... Shapes>
+template <typename Func, std::size_t... I>
+inline bool StaticScene<Shapes...>::any_type(Func&& func, std::index_sequence<I...>) {
+    return (func(std::integral_constant<std::size_t, I>()) || ...);
+}
+
+template <typename... Shapes>
+template <typename T, typename... Args>
+inline void StaticScene<Shapes...>::add_shape(Args&&... args) {
+    std::get<std::vector<T>>(this->shapes).emplace_back(args...).id = ++this->shape_count;
+    this->bvh_dirty = true;
+    this->radiance_cache->clear();
+}
+
+template <typename... Shapes>
+inline void StaticScene<Shapes...>::update_bvh() const {
+    if (!this->bvh_dirty) {
+        return;
+    }
+    // Adding shapes may have moved them, so the store is rebuilt from scratch
+    this->primitives = PrimitiveStore();
+    for_each_type([&](auto index) {
+        constexpr std::size_t I = decltype(index)::value;
+        using T = ShapeType<I>;
+        std::vector<T>& shapes = std::get<I>(this->shapes);
+        this->stored[I] = !shapes.empty() && shapes.front().T::primitive_kind() != PrimitiveKind::Custom;
+        if (this->stored[I]) {
+            for (T const& shape : shapes) {
+                this->primitives.add(&shape);
+            }
+            return;
+        }
+        std::vector<AABB> bounds;
+        bounds.reserve(shapes.size());
+        for (T const& shape : shapes) {
+            std::optional<AABB> box = shape.T::bounds();
+            if (!box) {
+                break;
+            }
+            bounds.push_back(box.value());
+        }
+        this->bounded[I] = !shapes.empty() && bounds.size() == shapes.size();
+        if (!this->bounded[I]) {
+            return;
+        }
+        this->bvhs[I].build(bounds);
+
+        // Lay out the shapes in leaf order, so that each leaf is a range
+        std::vector<T> reordered;
+        reordered.reserve(shapes.size());
+        for (int i : this->bvhs[I].leaf_order()) {
+            reordered.push_back(std::move(shapes[i]));
+        }
+        shapes = std::move(reordered);
+    },
+        std::index_sequence_for<Shapes...>());
+    this->primitives.build();
+    this->bvh_dirty = false;
+}
+
+template <typename... Shapes>
+template <std::size_t I, typename Func>
+inline bool StaticScene<Shapes...>::visit_shapes(Ray const& ray, float& t_max, Func&& visit) const {
+    int count = std::get<I>(this->shapes).size();
+    if (this->bvh_dirty) {
+        // The BVH is out of date (shapes were added outside of `render()`)
+        return visit(0, count);
+    }
+    if (this->stored[I]) {
+        return false;
+    }
+    if (!this->bounded[I]) {
+        return visit(0, count);
+    }
+    return this->bvhs[I].traverse_leaves(ray, t_max, visit);
+}
+
+template <typename... Shapes>
+template <std::size_t I, typename Func>
+inline void StaticScene<Shapes...>::visit_shapes(RayPacket const& packet, PacketFloat const& t_max, Func&& visit) const {
+    int count = std::get<I>(this->shapes).size();
+    if (this->bvh_dirty || (!this->stored[I] && !this->bounded[I])) {
+        visit(0, count);
+    } else if (!this->stored[I]) {
+        this->bvhs[I].traverse_packet_leaves(packet, t_max, visit);
+    }
+}
+
+template <typename... Shapes>
+inline Shape const* StaticScene<Shapes...>::intersect(Ray const& ray, float& t_min) const {
+    Shape const* closest = this->bvh_dirty ? nullptr : this->primitives.intersect(ray, t_min);
+    for_each_type([&](auto index) {
+        constexpr std::size_t I = decltype(index)::value;
+        using T = ShapeType<I>;
+        std::vector<T> const& shapes = std::get<I>(this->shapes);
+        this->template visit_shapes<I>(ray, t_min, [&](int first, int count) {
+            STATS_ADD(intersection_tests, count);
+            for (int i = first; i < first + count; i++) {
+                // Naming the type makes the call non-virtual
+                std::optional<float> t = shapes[i].T::intersect_first(ray);
+                if (t && t.value() < t_min) {
+                    t_min = t.value();
+                    closest = &shapes[i];
+                }
+            }
+            return false; // keep looking for closer intersections
+        });
+    },
+        std::index_sequence_for<Shapes...>());
+    return closest;
+}
+
+template <typename... Shapes>
+inline void StaticScene<Shapes...>::intersect_packet(RayPacket const& packet, PacketHit& hit) const {
+    if (!this->bvh_dirty) {
+        this->primitives.intersect(packet, hit);
+    }
+    for_each_type([&](auto index) {
+        constexpr std::size_t I = decltype(index)::value;
+        using T = ShapeType<I>;
+        std::vector<T> const& shapes = std::get<I>(this->shapes);
+        this->template visit_shapes<I>(packet, hit.t, [&](int first, int count) {
+            STATS_ADD(intersection_tests, count * kPacketSize); // one test per lane
+            for (int i = first; i < first + count; i++) {
+                shapes[i].T::intersect_packet(packet, hit);
+            }
+        });
+    },
+        std::index_sequence_for<Shapes...>());
+}
+
+template <typename... Shapes>
+inline bool StaticScene<Shapes...>::occluded(Ray const& ray, float t_max) const {
+    if (!this->bvh_dirty && this->primitives.occluded(ray, t_max)) {
+        return true;
+    }
+    return any_type([&](auto index) {
+        constexpr std::size_t I = decltype(index)::value;
+        using T = ShapeType<I>;
+        std::vector<T> const& shapes = std::get<I>(this->shapes);
+        float t_limit = t_max;
+        return this->template visit_shapes<I>(ray, t_limit, [&](int first, int count) {
+            STATS_ADD(intersection_tests, count);
+            for (int i = first; i < first + count; i++) {
+                if (shapes[i].T::intersects_any(ray, t_max)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    },
+        std::index_sequence_for<Shapes...>());
+}
+
+template <typename... Shapes>
+inline Color StaticScene<Shapes...>::trace(Ray const& ray, int recursion_depth, float weight) const {
+    float t = std::numeric_limits<float>::infinity();
+    Shape const* shape = this->intersect(ray, t);
+    return this->shade(ray, t, shape, recursion_depth, weight);
+}
+
+template <typename... Shapes>
+inline Color StaticScene<Shapes...>::shade(Ray const& ray, float t, Shape const* shape, int recursion_depth, float weight) const {
+    STATS_DEPTH(this->recursion_depth - recursion_depth);
+    if (!shape) {
+        return this->background;
+    }
+    Point point = ray.at(t);
+    Color color = this->background;
+    // Find which array the shape is in, which gives back its type
+    any_type([&](auto index) {
+        constexpr std::size_t I = decltype(index)::value;
+        using T = ShapeType<I>;
+        std::vector<T> const& shapes = std::get<I>(this->shapes);
+        if (shapes.empty()
+            || std::less<Shape const*>()(shape, &shapes.front())
+            || std::less<Shape const*>()(&shapes.back(), shape)) {
+            return false;
+        }
+        T const& typed = static_cast<T const&>(*shape);
+        Vector normal = typed.T::normal_at(point);
+        if constexpr (has_typed_shading<T, StaticScene>::value) {
+            auto&& material = typed.typed_material_at(point);
+            if (GBuffer::active) {
+                GBuffer::record(ray, t, shape, normal, material.albedo());
+            }
+            color = material.shade(ray.direction, point, normal, *this, recursion_depth, weight);
+        } else {
+            MaterialStorage storage;
+            Material const& material = typed.T::material_at(point, storage);
+            if (GBuffer::active) {
+                GBuffer::record(ray, t, shape, normal, material.albedo());
+            }
+            color = material.get_color(ray.direction, point, normal, this, recursion_depth, weight);
+        }
+        return true;
+    },
+        std::index_sequence_for<Shapes...>());
+    return color;
+}
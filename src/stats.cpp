@@ -0,0 +1,20 @@
+#include "stats.hpp"
+
+uint64_t RayCounters::total_rays() const {
+    return this->primary_rays + this->shadow_rays + this->reflection_rays + this->refraction_rays;
+}
+
+void RayCounters::merge(RayCounters const& other) {
+    this->primary_rays += other.primary_rays;
+    this->shadow_rays += other.shadow_rays;
+    this->reflection_rays += other.reflection_rays;
+    this->refraction_rays += other.refraction_rays;
+    this->intersection_tests += other.intersection_tests;
+    this->pbr_samples += other.pbr_samples;
+    this->pruned_rays += other.pruned_rays;
+    this->cache_hits += other.cache_hits;
+    this->supersampled_pixels += other.supersampled_pixels;
+    for (int d = 0; d < kMaxDepth; d++) {
+        this->depth_histogram[d] += other.depth_histogram[d];
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "scheduler.hpp"
+
+/**
+ * @brief Ray and intersection counters of one thread, or merged over all
+ * threads. Only gathered when compiled with `-DRAYTRACER_STATS` (e.g.,
+ * `make scene STATS=1`); otherwise the `STATS_*` macros below expand to
+ * nothing and every counter stays zero.
+ */
+struct RayCounters {
+    static constexpr int kMaxDepth = 16; // deeper traces go into the last bucket
+
+    uint64_t primary_rays = 0;
+    uint64_t shadow_rays = 0;
+    uint64_t reflection_rays = 0;
+    uint64_t refraction_rays = 0;
+    uint64_t intersection_tests = 0; // ray-shape tests, including shadow rays
+    uint64_t pbr_samples = 0; // importance samples taken by `PBRMaterial`
+    uint64_t pruned_rays = 0; // secondary rays not traced (see `RenderSettings::min_weight`)
+    uint64_t cache_hits = 0; // `PBRMaterial` samples answered by the radiance cache instead of a ray
+    uint64_t supersampled_pixels = 0; // pixels on edges, with more primary rays (see `AntialiasingSettings`)
+    // Number of rays traced at each recursion depth (0 for primary rays)
+    std::array<uint64_t, kMaxDepth> depth_histogram {};
+
+    uint64_t total_rays() const; // primary, shadow, reflection and refraction rays
+    void merge(RayCounters const& other); // add `other` (in-place)
+};
+
+/**
+ * @brief Statistics of one call to `SceneBase::render()` (or
+ * `SceneBase::render_progressive()`).
+ */
+struct RenderStats {
+    RayCounters counters; // summed over all threads; zero unless enabled
+    std::vector<TileTiming> tile_timings; // one per tile (or row)
+    double milliseconds = 0.0; // wall-clock time of the render
+    int passes = 1; // taken by `SceneBase::render_progressive()`
+    // Whether `counters` were gathered in this build
+#ifdef RAYTRACER_STATS
+    static constexpr bool kEnabled = true;
+#else
+    static constexpr bool kEnabled = false;
+#endif
+};
+
+#ifdef RAYTRACER_STATS
+// Counters of the current thread; reset and merged by `SceneBase::render_rows()`
+inline thread_local RayCounters thread_counters;
+
+#define STATS_ADD(counter, n) (thread_counters.counter += (n))
+#define STATS_DEPTH(depth) (thread_counters.depth_histogram[std::min((depth), RayCounters::kMaxDepth - 1)]++)
+#else
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_DEPTH(depth) ((void)0)
+#endif
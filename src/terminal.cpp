@@ -0,0 +1,191 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <iterator>
+#include <poll.h>
+#include <unistd.h>
+
+#include "terminal.hpp"
+
+// Unchanged cells between two changed ones are redrawn rather than
+// skipped when that's shorter than a cursor movement escape
+constexpr int kMaxRedrawGap = 2;
+
+namespace {
+
+// Mode saved by the live `RawInput`, for restoring the terminal when the
+// process is killed or exits without unwinding the stack
+termios restore_mode;
+volatile std::sig_atomic_t restore_pending = 0;
+
+constexpr int kRestoreSignals[] = { SIGINT, SIGTERM, SIGQUIT, SIGHUP };
+struct sigaction previous_actions[std::size(kRestoreSignals)];
+
+void restore_terminal() {
+    if (restore_pending) {
+        restore_pending = 0;
+        ::tcsetattr(STDIN_FILENO, TCSANOW, &restore_mode);
+    }
+}
+
+// Only calls async-signal-safe functions
+void restore_terminal_and_raise(int signal) {
+    restore_terminal();
+    // Reset colors and re-enable line wrap, in case a frame was cut short
+    char const reset[] = "\033[0m\033[?7h\n";
+    if (::write(STDOUT_FILENO, reset, sizeof(reset) - 1) < 0) {
+        // Nothing else to do
+    }
+    // Die from the signal as if it had not been caught; it's blocked until
+    // this handler returns
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+} // namespace
+
+void TerminalFrame::invalidate() {
+    this->valid = false;
+}
+
+std::string const& TerminalFrame::draw(std::vector<int> const& cells, int width, int height, int padding, std::string const& status) {
+    std::string& out = this->output;
+    out.clear();
+    // Disable line wrap to avoid automatic wrapping in some terminals
+    out += "\033[?7l";
+
+    if (!this->valid || width != this->width || height != this->height || padding != this->padding) {
+        // Clear screen, and mark every cell as unknown
+        out += "\033[2J";
+        this->width = width;
+        this->height = height;
+        this->padding = padding;
+        this->previous.assign(width * height, -1);
+        this->valid = true;
+    }
+
+    int current = -1; // color set by the last escape in this frame
+    for (int i = 0; i < height; i++) {
+        int const* row = cells.data() + i * width;
+        int* prev_row = this->previous.data() + i * width;
+        int j = 0;
+        while (j < width) {
+            if (row[j] == prev_row[j]) {
+                j++;
+                continue;
+            }
+            // Start of a run of changed cells: move the cursor there (1-based)
+            out += "\033[" + std::to_string(i + 1) + ";" + std::to_string(padding + 2 * j + 1) + "H";
+            int gap = 0; // unchanged cells seen since the last changed one
+            int end = j; // one past the last changed cell of the run
+            for (int k = j; k < width && gap <= kMaxRedrawGap; k++) {
+                if (row[k] == prev_row[k]) {
+                    gap++;
+                } else {
+                    gap = 0;
+                    end = k + 1;
+                }
+            }
+            for (int k = j; k < end; k++) {
+                if (row[k] != current) {
+                    out += "\033[48;5;" + std::to_string(row[k]) + "m"; // 256-color background
+                    current = row[k];
+                }
+                out += "  ";
+                prev_row[k] = row[k];
+            }
+            j = end;
+        }
+    }
+
+    // Reset colors, then write the status line below the image
+    out += "\033[0m\033[" + std::to_string(height + 1) + ";1H\033[K" + status;
+    // Re-enable line wrap
+    out += "\033[?7h";
+    return out;
+}
+
+void TerminalFrame::present(std::vector<int> const& cells, int width, int height, int padding, std::string const& status) {
+    std::string const& out = this->draw(cells, width, height, padding, status);
+    std::size_t written = 0;
+    while (written < out.size()) {
+        ssize_t n = ::write(STDOUT_FILENO, out.data() + written, out.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            this->valid = false; // the screen is in an unknown state
+            return;
+        }
+        written += n;
+    }
+}
+
+RawInput::RawInput() {
+    if (!::isatty(STDIN_FILENO) || ::tcgetattr(STDIN_FILENO, &this->saved) != 0) {
+        return;
+    }
+    termios raw = this->saved;
+    raw.c_lflag &= ~(ICANON | ECHO); // no line buffering, no echo
+    raw.c_cc[VMIN] = 0; // reads return immediately, possibly empty
+    raw.c_cc[VTIME] = 0;
+    this->active = ::tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    if (!this->active) {
+        return;
+    }
+
+    // The destructor doesn't run on Ctrl-C, `kill` or `std::exit()`
+    restore_mode = this->saved;
+    restore_pending = 1;
+    static bool registered = std::atexit(restore_terminal) == 0;
+    (void)registered;
+    struct sigaction action = {};
+    action.sa_handler = restore_terminal_and_raise;
+    sigemptyset(&action.sa_mask);
+    for (std::size_t k = 0; k < std::size(kRestoreSignals); k++) {
+        ::sigaction(kRestoreSignals[k], nullptr, &previous_actions[k]);
+        if (previous_actions[k].sa_handler != SIG_IGN) { // e.g., under nohup
+            ::sigaction(kRestoreSignals[k], &action, nullptr);
+        }
+    }
+}
+
+RawInput::~RawInput() {
+    if (this->active) {
+        for (std::size_t k = 0; k < std::size(kRestoreSignals); k++) {
+            ::sigaction(kRestoreSignals[k], &previous_actions[k], nullptr);
+        }
+        restore_pending = 0;
+        ::tcsetattr(STDIN_FILENO, TCSANOW, &this->saved);
+    }
+}
+
+std::string RawInput::read_keys(int timeout_ms) {
+    std::string keys;
+    pollfd fd { STDIN_FILENO, POLLIN, 0 };
+    if (::poll(&fd, 1, timeout_ms) <= 0) {
+        return keys;
+    }
+    // Drain everything that's already there
+    char buffer[64];
+    while (true) {
+        ssize_t n = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            // End of input, or the terminal hung up: poll() would keep
+            // reporting it, so the caller has to stop reading
+            keys += '\0';
+        }
+        if (n <= 0) {
+            break;
+        }
+        keys.append(buffer, n);
+        fd.revents = 0;
+        if (::poll(&fd, 1, 0) <= 0) {
+            break;
+        }
+    }
+    return keys;
+}
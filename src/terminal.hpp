@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <termios.h>
+
+/**
+ * @brief Double-buffered frame for drawing images in the terminal, where
+ * each cell is two spaces with a 256-color background.
+ *
+ * The previous frame is remembered, so only cells whose color changed are
+ * redrawn, a color escape is only emitted when the color differs from the
+ * one last set, and the whole update goes out in a single `write(2)`.
+ */
+class TerminalFrame {
+private:
+    int width = 0; // in cells
+    int height = 0;
+    int padding = 0; // columns left of the image
+    std::vector<int> previous; // color index of each cell on screen, row by row
+    bool valid = false; // whether `previous` matches what's on screen
+    std::string output; // reused between frames to avoid reallocating
+
+public:
+    /**
+     * @brief Forget what's on screen, so that the next `present()` clears
+     * the screen and redraws everything (e.g., after other output).
+     */
+    void invalidate();
+
+    /**
+     * @brief Build the output that updates the screen to a frame, and
+     * remember the frame as being on screen, without writing anything.
+     * Takes the same parameters as `present()`.
+     * @return The escapes and text to write, valid until the next call
+     */
+    std::string const& draw(std::vector<int> const& cells, int width, int height, int padding, std::string const& status);
+
+    /**
+     * @brief Draw a frame, updating only the cells that changed, and write
+     * it to stdout.
+     * @param cells xterm 256-color index of each cell, row by row
+     * @param width Number of cells per row
+     * @param height Number of rows
+     * @param padding Number of columns left of the image
+     * @param status Text for the line below the image, where the cursor is
+     * left afterwards
+     */
+    void present(std::vector<int> const& cells, int width, int height, int padding, std::string const& status);
+};
+
+/**
+ * @brief Puts the terminal into raw mode while alive: keys are delivered
+ * immediately, without waiting for Enter, and are not echoed. The previous
+ * mode is restored on destruction, and also on exit and on SIGINT, SIGTERM,
+ * SIGQUIT or SIGHUP, which otherwise terminate the process without unwinding (the
+ * signal is re-raised afterwards). Only one instance may be alive at a
+ * time. Does nothing if stdin is not a terminal.
+ */
+class RawInput {
+private:
+    bool active = false; // whether the terminal mode was changed
+    termios saved; // mode to restore
+
+public:
+    RawInput();
+    RawInput(RawInput const&) = delete;
+    RawInput& operator=(RawInput const&) = delete;
+    ~RawInput();
+
+    /**
+     * @brief Wait up to `timeout_ms` milliseconds for input, then read all
+     * keys that are available without blocking.
+     * @return The keys read, in order; empty on timeout. A `'\0'` key is
+     * appended on end of input, including when the terminal hangs up.
+     */
+    std::string read_keys(int timeout_ms);
+};
@@ -1,16 +1,58 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <new>
+#include <vector>
 
+#include <omp.h>
+
+#include "aov.hpp"
+#include "bench.hpp"
+#include "bvh.hpp"
 #include "color.hpp"
+#include "image.hpp"
 #include "material.hpp"
+#include "packet.hpp"
+#include "radiance_cache.hpp"
 #include "materials/basic.hpp"
+#include "materials/pbr.hpp"
+#include "materials/transparent.hpp"
+#include "scheduler.hpp"
 #include "shape.hpp"
 #include "shapes/plane.hpp"
 #include "shapes/sphere.hpp"
+#include "static_scene.hpp"
+#include "terminal.hpp"
 #include "ui.hpp"
 #include "vector.hpp"
 
+// Heap allocations made by the calling thread, counted by the replaced
+// global `operator new` below
+thread_local std::size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+    allocations++;
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
 void test_scene() {
     Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
     Screen screen(10.0f, 10.0f);
@@ -32,6 +74,1037 @@ bool approx_eq(float a, float b) {
     return std::abs(a - b) < 1e-4;
 }
 
+// Uniform random float in [lo, hi)
+float random_float(float lo, float hi) {
+    return lo + (hi - lo) * ((float)std::rand() / ((float)RAND_MAX + 1.0f));
+}
+
+// A sphere that isn't a `BasicSphere`, like `SoccerBall` in the scenes
+class CustomSphere : public Sphere {
+private:
+    BasicMaterial material = BasicMaterial(Color::white(), 0.0f);
+
+public:
+    using Sphere::Sphere;
+    Material const& material_at(Point const&, MaterialStorage&) const override {
+        return this->material;
+    }
+};
+
+void test_vector_batches() {
+    // Batch operators agree with the scalar ones, including past the last
+    // full packet
+    std::srand(221);
+    VectorArrays a, b;
+    int count = 3 * kPacketSize + 1;
+    for (int i = 0; i < count; i++) {
+        a.push_back(Vector(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5)));
+        b.push_back(Vector(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5)));
+    }
+    std::vector<float> dots(count + kPacketSize);
+    batch_dot(a, b, dots.data());
+    VectorArrays cross;
+    batch_cross(a, b, cross);
+    assert(cross.count == count);
+    VectorArrays normalized = a;
+    batch_normalize(normalized);
+    for (int i = 0; i < count; i++) {
+        assert(approx_eq(dots[i], a[i] * b[i]));
+        assert(~(cross[i] - (a[i] ^ b[i])) < 1e-4f);
+        assert(~(normalized[i] - !a[i]) < 1e-6f);
+    }
+    // Padding stays zero
+    for (int k = 0; k < kPacketSize; k++) {
+        assert(normalized.x[count + k] == 0.0f && cross.z[count + k] == 0.0f);
+    }
+}
+
+void test_bvh() {
+    // Compare the BVH against brute force on random spheres and rays
+    std::srand(221);
+    BasicMaterial material(Color::white(), 0.0f);
+    std::vector<std::unique_ptr<Sphere>> spheres;
+    std::vector<AABB> bounds;
+    for (int i = 0; i < 500; i++) {
+        Point center(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5));
+        spheres.push_back(std::make_unique<BasicSphere<>>(center, random_float(0.05f, 0.5f), material));
+        bounds.push_back(spheres.back()->bounds().value());
+    }
+    BVH bvh;
+    bvh.build(bounds);
+    assert(!bvh.empty());
+
+    for (int i = 0; i < 2000; i++) {
+        Ray ray(Point(random_float(-6, 6), random_float(-6, 6), random_float(-6, 6)),
+            Vector(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+        float brute = std::numeric_limits<float>::infinity();
+        for (auto&& sphere : spheres) {
+            std::optional<float> t = sphere->intersect_first(ray);
+            if (t && t.value() < brute) {
+                brute = t.value();
+            }
+        }
+        float t_min = std::numeric_limits<float>::infinity();
+        bvh.traverse(ray, t_min, [&](int index) {
+            std::optional<float> t = spheres[index]->intersect_first(ray);
+            if (t && t.value() < t_min) {
+                t_min = t.value();
+            }
+            return false;
+        });
+        assert(t_min == brute);
+    }
+
+    // The scene gives the same answer before and after building its BVH
+    Camera camera;
+    Screen screen;
+    Scene scene(&camera, &screen, 0.8f, 0.5f, 8., Color::black());
+    // Basic spheres and planes go to the primitive arrays, the others
+    // through virtual calls; both are compared to brute force
+    std::vector<Shape const*> all_shapes;
+    for (int i = 0; i < 100; i++) {
+        Point center(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5));
+        std::unique_ptr<Shape> sphere;
+        if (i % 10 == 0) {
+            sphere = std::make_unique<CustomSphere>(center, random_float(0.05f, 0.5f));
+        } else {
+            sphere = std::make_unique<BasicSphere<>>(center, random_float(0.05f, 0.5f), material);
+        }
+        all_shapes.push_back(sphere.get());
+        scene.add_shape(std::move(sphere));
+    }
+    for (float z : { -6.0f, 6.5f }) {
+        auto plane = std::make_unique<BasicPlane<>>(Point(0.0f, 0.0f, z), Vector(0.1f, 0.0f, 1.0f), material);
+        all_shapes.push_back(plane.get());
+        scene.add_shape(std::move(plane));
+    }
+    std::vector<Ray> rays;
+    std::vector<std::optional<float>> before;
+    for (int i = 0; i < 500; i++) {
+        rays.emplace_back(Point(random_float(-6, 6), random_float(-6, 6), random_float(-6, 6)),
+            Vector(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+        auto hit = scene.intersect_first_all(rays.back());
+        before.push_back(hit ? std::optional<float>(hit.value().first) : std::nullopt);
+        float brute = std::numeric_limits<float>::infinity();
+        for (Shape const* shape : all_shapes) {
+            std::optional<float> t = shape->intersect_first(rays.back());
+            if (t && t.value() < brute) {
+                brute = t.value();
+            }
+        }
+        assert(hit ? approx_eq(hit.value().first / brute, 1.0f) : std::isinf(brute));
+    }
+    scene.update_bvh();
+    for (std::size_t i = 0; i < rays.size(); i++) {
+        auto hit = scene.intersect_first_all(rays[i]);
+        assert(hit.has_value() == before[i].has_value());
+        assert(!hit || hit.value().first == before[i].value());
+        // Any-hit queries agree with the closest hit
+        for (float t_max : { 0.5f, 2.0f, 10.0f }) {
+            assert(scene.occluded(rays[i], t_max) == (hit && hit.value().first < t_max));
+        }
+    }
+    // Packets find the same closest hits, including partially filled ones
+    for (std::size_t i = 0; i < rays.size(); i += kPacketSize) {
+        RayPacket packet;
+        int count = std::min<int>(kPacketSize, rays.size() - i);
+        for (int k = 0; k < count; k++) {
+            packet.set(k, rays[i + k]);
+        }
+        PacketHit packet_hit;
+        scene.intersect_packet(packet, packet_hit);
+        for (int k = 0; k < kPacketSize; k++) {
+            auto hit = k < count ? scene.intersect_first_all(rays[i + k]) : std::nullopt;
+            assert((packet_hit.shape[k] != nullptr) == hit.has_value());
+            assert(!hit || approx_eq(packet_hit.t[k] / hit.value().first, 1.0f));
+        }
+    }
+    std::cout << "BVH matched brute force intersection." << std::endl;
+}
+
+void test_scheduler() {
+    // Every pixel is covered exactly once, whatever the order and tile size
+    for (TileOrder order : { TileOrder::Scanline, TileOrder::Morton, TileOrder::Hilbert }) {
+        for (int tile_size : { 1, 7, 16, 64 }) {
+            int width = 37, height = 23;
+            TileScheduler scheduler(width, height, tile_size, order);
+            std::vector<int> covered(width * height, 0);
+            std::vector<TileTiming> timings = scheduler.run([&](Tile const& tile) {
+                for (int i = tile.y0; i < tile.y1; i++) {
+                    for (int j = tile.x0; j < tile.x1; j++) {
+                        #pragma omp atomic
+                        covered[i * width + j]++;
+                    }
+                }
+            });
+            assert(timings.size() == scheduler.get_tiles().size());
+            for (int c : covered) {
+                assert(c == 1);
+            }
+        }
+    }
+
+    // Row and tile schedules produce the same image
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.8f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<>>(Point(0.25f, 0.45f, 0.4f), 0.4f, BasicMaterial(Color::from_rgb(255, 0, 0), 0.4f));
+    scene.add_shape<BasicPlane<>>(Point(0.0f, 0.0f, -0.1f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::white(), 0.5f));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    RenderSettings settings;
+    settings.schedule = RenderSchedule::Rows;
+    scene.set_settings(settings);
+    RenderStats stats;
+    std::vector<Color> rows = scene.render(40, 30, &stats);
+    assert(stats.tile_timings.size() == 30);
+    settings.schedule = RenderSchedule::Tiles;
+    settings.tile_size = 8;
+    scene.set_settings(settings);
+    std::vector<Color> tiles = scene.render(40, 30, &stats);
+    assert(stats.tile_timings.size() == 5 * 4);
+    // Counters are exact whatever the schedule: one primary ray per pixel,
+    // at least one intersection test for each of them
+    RayCounters const& counters = stats.counters;
+    if (RenderStats::kEnabled) {
+        assert(counters.primary_rays == 40 * 30);
+        assert(counters.depth_histogram[0] == counters.primary_rays);
+        assert(counters.intersection_tests >= counters.primary_rays);
+        assert(counters.reflection_rays > 0 && counters.shadow_rays > 0);
+        assert(counters.total_rays() == counters.primary_rays + counters.shadow_rays
+            + counters.reflection_rays + counters.refraction_rays);
+    } else {
+        assert(counters.total_rays() == 0 && counters.intersection_tests == 0);
+    }
+    for (std::size_t i = 0; i < rows.size(); i++) {
+        assert(rows[i].get_rgb() == tiles[i].get_rgb());
+    }
+    // Packets of primary rays, with a tile width that isn't a multiple of
+    // the packet size
+    settings.tile_size = 7;
+    settings.packets = false;
+    scene.set_settings(settings);
+    std::vector<Color> single = scene.render(40, 30);
+    settings.packets = true;
+    scene.set_settings(settings);
+    std::vector<Color> packets = scene.render(40, 30);
+    for (std::size_t i = 0; i < single.size(); i++) {
+        auto a = single[i].get_rgb();
+        auto b = packets[i].get_rgb();
+        for (int c = 0; c < 3; c++) {
+            assert(std::abs((int)a[c] - (int)b[c]) <= 1); // SIMD rounding may differ slightly
+        }
+    }
+    std::cout << "Tile scheduler covered every pixel once." << std::endl;
+}
+
+void test_light_culling() {
+    // The same plane lit by nothing, by a light behind it, and by that
+    // light plus one in front of it
+    Camera camera(Point(0.5f, -1.5f, 0.5f), !Vector(0.0f, 1.0f, -0.5f));
+    Screen screen(10.0f, 10.0f);
+    Scene dark(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    Scene behind(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    Scene front(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    for (Scene* scene : { &dark, &behind, &front }) {
+        scene->add_shape<BasicPlane<>>(Point(0.0f, 0.0f, 0.0f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::from_rgb(200, 200, 200), 0.0f));
+    }
+    behind.add_light<BasicPointLight>(Point(0.5, 0.5, -1.0));
+    front.add_light<BasicPointLight>(Point(0.5, 0.5, -1.0));
+    front.add_light<BasicPointLight>(Point(0.5, 0.5, 1.0));
+
+    // Only the light in front is visited, even with nothing in the way of
+    // the other one, and nothing is allocated
+    Scene open(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    open.add_light<BasicPointLight>(Point(0.5, 0.5, -1.0));
+    open.add_light<BasicPointLight>(Point(0.5, 0.5, 1.0));
+    Point point(0.5f, 0.5f, 0.0f);
+    Vector up(0.0f, 0.0f, 1.0f);
+    int visited = 0;
+    std::size_t allocated = allocations;
+    open.for_each_visible_light(point, up, [&](Light const& light) {
+        assert(light.get_direction(point) * up > 0);
+        visited++;
+    });
+    assert(allocations == allocated);
+    assert(visited == 1);
+
+    // The light behind adds nothing and casts no shadow rays
+    RenderStats stats;
+    std::vector<Color> unlit = dark.render(40, 40);
+    std::vector<Color> culled = behind.render(40, 40, &stats);
+    if (RenderStats::kEnabled) {
+        assert(stats.counters.shadow_rays == 0);
+    }
+    for (std::size_t i = 0; i < unlit.size(); i++) {
+        assert(unlit[i].get_raw() == culled[i].get_raw());
+    }
+    // The light in front lights every pixel of the plane, after one shadow
+    // ray each
+    std::vector<Color> lit = front.render(40, 40, &stats);
+    uint64_t brighter = 0;
+    for (std::size_t i = 0; i < unlit.size(); i++) {
+        brighter += lit[i].luminance() > unlit[i].luminance();
+    }
+    assert(brighter > 0);
+    if (RenderStats::kEnabled) {
+        assert(stats.counters.shadow_rays == brighter);
+    }
+    std::cout << "Lights behind surfaces were skipped." << std::endl;
+}
+
+void test_ray_generator() {
+    // Same rays as going through `Screen::get_pixel()`, for a camera that
+    // isn't level and a screen that isn't square
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.2f, 1.0f, -0.3f));
+    Screen screen(12.0f, 8.0f, 7);
+    int width = 37, height = 23;
+    RayGenerator rays(camera, screen, width, height);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            Point pixel = screen.get_pixel((j + 0.5f) / width, (i + 0.5f) / height, &camera);
+            Ray ray = rays.ray(i, j);
+            assert(ray.origin == camera.get_position());
+            assert(~(ray.direction - (pixel - camera.get_position())) < 1e-4f);
+        }
+        // Packets, including a partial one at the end of the row
+        for (int j = 0; j < width; j += kPacketSize) {
+            RayPacket packet;
+            int count = std::min(kPacketSize, width - j);
+            rays.packet(i, j, count, packet);
+            for (int k = 0; k < kPacketSize; k++) {
+                assert((packet.active[k] != 0) == (k < count));
+                if (k < count) {
+                    assert(~(packet.ray(k).direction - rays.ray(i, j + k).direction) < 1e-4f);
+                }
+            }
+        }
+    }
+    // Subpixel offsets
+    Point corner = screen.get_pixel(0.0f, 0.0f, &camera);
+    assert(~(rays.ray(0, 0, 0.0f, 0.0f).direction - (corner - camera.get_position())) < 1e-4f);
+    RayGenerator jittered(camera, screen, width, height, 0.25f, 0.75f);
+    assert(~(jittered.ray(5, 7).direction - rays.ray(5, 7, 0.25f, 0.75f).direction) < 1e-6f);
+
+    // A region of interest renders the same pixels as the whole image and
+    // leaves the others black
+    Screen square(10.0f, 10.0f);
+    Scene scene(&camera, &square, 0.8f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<>>(Point(0.25f, 0.45f, 0.4f), 0.4f, BasicMaterial(Color::from_rgb(255, 0, 0), 0.4f));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    // (one ray at a time, since the region moves the packets' boundaries)
+    RenderSettings settings;
+    settings.packets = false;
+    scene.set_settings(settings);
+    std::vector<Color> full = scene.render(width, height);
+    Tile region { 5, 3, 60, 17 }; // clipped to the image
+    for (RenderSchedule schedule : { RenderSchedule::Rows, RenderSchedule::Tiles }) {
+        settings.schedule = schedule;
+        settings.tile_size = 8;
+        settings.region = region;
+        scene.set_settings(settings);
+        std::vector<Color> cropped = scene.render(width, height);
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                bool inside = i >= region.y0 && i < region.y1 && j >= region.x0;
+                Color expected = inside ? full[i * width + j] : Color::black();
+                assert(cropped[i * width + j].get_rgb() == expected.get_rgb());
+            }
+        }
+    }
+    std::cout << "Ray generator matched the screen's pixels." << std::endl;
+}
+
+void test_pruning() {
+    // Glass in front of a mirror-like floor: the reflection and refraction
+    // trees are deep, but most branches contribute nothing visible
+    Camera camera(Point(0.0f, -1.5f, 0.5f), Vector(0.0f, 1.0f, -0.2f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.2f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicPlane<>>(Point(0.0f, 0.0f, -0.5f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::from_rgb(0, 0, 255), 0.6f));
+    scene.add_shape<BasicSphere<TransparentMaterial>>(Point(0.3f, 0.3f, 0.3f), 0.3f, TransparentMaterial(1.6f));
+    scene.add_shape<BasicSphere<TransparentMaterial>>(Point(-0.3f, 0.6f, 0.0f), 0.3f, TransparentMaterial(1.33f));
+    scene.add_light<BasicPointLight>(Point(0.5, -0.5, 1.0));
+
+    RenderSettings settings;
+    settings.min_weight = 0.0f;
+    scene.set_settings(settings);
+    RenderStats full_stats;
+    std::vector<Color> full = scene.render(60, 60, &full_stats);
+    for (bool roulette : { false, true }) {
+        settings.min_weight = RenderSettings().min_weight;
+        settings.russian_roulette = roulette;
+        scene.set_settings(settings);
+        RenderStats stats;
+        std::vector<Color> pruned = scene.render(60, 60, &stats);
+        int changed = 0;
+        for (std::size_t i = 0; i < full.size(); i++) {
+            auto a = full[i].get_rgb();
+            auto b = pruned[i].get_rgb();
+            for (int c = 0; c < 3; c++) {
+                changed += std::abs((int)a[c] - (int)b[c]) > 2;
+            }
+        }
+        assert(changed <= (int)full.size() / 100);
+        if (roulette) {
+            // The roulette doesn't depend on which thread renders what
+            int threads = omp_get_max_threads();
+            omp_set_num_threads(1);
+            std::vector<Color> serial = scene.render(60, 60);
+            omp_set_num_threads(threads);
+            for (std::size_t i = 0; i < pruned.size(); i++) {
+                assert(serial[i].get_raw() == pruned[i].get_raw());
+            }
+        }
+        if (RenderStats::kEnabled) {
+            assert(full_stats.counters.pruned_rays == 0);
+            assert(stats.counters.pruned_rays > 0);
+            assert(stats.counters.total_rays() < full_stats.counters.total_rays());
+        }
+    }
+    std::cout << "Pruned ray trees matched the full ones." << std::endl;
+}
+
+void test_iterative() {
+    // The iterative integrators add up the same terms in the same order as
+    // the recursive tracer, so the images are identical
+    Camera camera(Point(0.0f, -1.5f, 0.5f), Vector(0.0f, 1.0f, -0.2f));
+    Screen screen(10.0f, 10.0f);
+    StaticScene<BasicPlane<>, BasicSphere<TransparentMaterial>, BasicSphere<>, BasicSphere<PBRMaterial>> scene(
+        &camera, &screen, 0.2f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicPlane<>>(Point(0.0f, 0.0f, -0.5f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::from_rgb(0, 0, 255), 0.6f));
+    scene.add_shape<BasicSphere<TransparentMaterial>>(Point(0.3f, 0.3f, 0.3f), 0.3f, TransparentMaterial(1.6f));
+    scene.add_shape<BasicSphere<TransparentMaterial>>(Point(-0.3f, 0.6f, 0.0f), 0.3f, TransparentMaterial(1.33f));
+    scene.add_shape<BasicSphere<>>(Point(0.0f, 1.2f, 0.2f), 0.4f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.8f));
+    scene.add_shape<BasicSphere<PBRMaterial>>(Point(0.6f, 1.0f, -0.2f), 0.3f, PBRMaterial(Color::from_rgb(200, 150, 50), 0.3f, 1.0f, 0.5f, 16));
+    scene.add_light<BasicPointLight>(Point(0.5, -0.5, 1.0));
+
+    for (float min_weight : { 0.0f, RenderSettings().min_weight }) {
+        RenderSettings settings;
+        settings.packets = false;
+        settings.min_weight = min_weight;
+        scene.set_settings(settings);
+        RenderStats expected_stats;
+        std::vector<Color> expected = scene.render(60, 60, &expected_stats);
+        settings.integrator = Integrator::Iterative;
+        scene.set_settings(settings);
+        RenderStats actual_stats;
+        std::vector<Color> actual = scene.render(60, 60, &actual_stats);
+        for (std::size_t i = 0; i < expected.size(); i++) {
+            assert(expected[i].get_rgb() == actual[i].get_rgb());
+        }
+        if (RenderStats::kEnabled) {
+            assert(actual_stats.counters.total_rays() == expected_stats.counters.total_rays());
+        }
+
+        // Past the budget, rays are traced recursively, without changing
+        // the image; packets only change the rounding
+        for (int budget : { 1 << 15, 100 }) {
+            settings.integrator = Integrator::Wavefront;
+            settings.ray_budget = budget;
+            scene.set_settings(settings);
+            std::vector<Color> wavefront = scene.render(60, 60);
+            for (std::size_t i = 0; i < expected.size(); i++) {
+                auto a = expected[i].get_rgb();
+                auto b = wavefront[i].get_rgb();
+                for (int c = 0; c < 3; c++) {
+                    assert(std::abs((int)a[c] - (int)b[c]) <= 1);
+                }
+            }
+        }
+    }
+    std::cout << "Iterative integrators matched the recursive tracer." << std::endl;
+}
+
+void test_pbr_sampling() {
+    // Every power-of-two prefix of the samples is stratified, however
+    // they are scrambled
+    for (int count : { 4, 16, 64 }) {
+        int side = std::sqrt(count);
+        std::vector<int> cells(count, 0);
+        for (int i = 0; i < count; i++) {
+            auto [u1, u2] = sobol_02(i);
+            assert(0.0f <= u1 && u1 < 1.0f && 0.0f <= u2 && u2 < 1.0f);
+            cells[(int)(u1 * side) * side + (int)(u2 * side)]++;
+        }
+        assert(std::count(cells.begin(), cells.end(), 1) == count);
+        for (SamplePattern pattern : { SamplePattern::OwenSobol, SamplePattern::BlueNoise }) {
+            for (uint32_t pixel : { Sampler::pixel_id(0, 0), Sampler::pixel_id(17, 3), Sampler::pixel_id(300, 1000) }) {
+                Sampler::pixel = pixel;
+                Sampler sampler(pattern, 3);
+                std::fill(cells.begin(), cells.end(), 0);
+                for (int i = 0; i < count; i++) {
+                    auto [u1, u2] = sampler.get(i);
+                    assert(0.0f <= u1 && u1 < 1.0f && 0.0f <= u2 && u2 < 1.0f);
+                    cells[(int)(u1 * side) * side + (int)(u2 * side)]++;
+                }
+                assert(std::count(cells.begin(), cells.end(), 1) == count);
+            }
+        }
+    }
+    // Scrambling depends on the pixel and the dimension only
+    Sampler::pixel = Sampler::pixel_id(5, 7);
+    Sampler sampler(SamplePattern::OwenSobol, 2);
+    assert(Sampler(SamplePattern::OwenSobol, 2).get(1) == sampler.get(1));
+    assert(Sampler(SamplePattern::OwenSobol, 3).get(1) != sampler.get(1));
+    Sampler::pixel = Sampler::pixel_id(5, 8);
+    assert(Sampler(SamplePattern::OwenSobol, 2).get(1) != sampler.get(1));
+    assert(Sampler(SamplePattern::Sobol, 2).get(1) == sobol_02(1));
+
+    // Stopping early barely changes the image
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<PBRMaterial>>(Point(0.25f, 0.45f, 0.4f), 0.2f, PBRMaterial(Color::raw(0.56, 0.57, 0.58), 0.5f, 1.0f, 0.5f, 256));
+    scene.add_shape<BasicPlane<PBRMaterial>>(Point(0.0f, 0.0f, -0.1f), Vector(0.0f, 0.0f, 1.0f), PBRMaterial(Color::from_rgb(200, 200, 200), 0.5f, 0.0f));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    RenderStats full_stats;
+    std::vector<Color> full = scene.render(40, 40, &full_stats);
+    RenderSettings settings;
+    settings.sample_tolerance = 1.0f / 1024;
+    scene.set_settings(settings);
+    RenderStats adaptive_stats;
+    std::vector<Color> adaptive = scene.render(40, 40, &adaptive_stats);
+    int changed = 0;
+    for (std::size_t i = 0; i < full.size(); i++) {
+        auto a = full[i].get_rgb();
+        auto b = adaptive[i].get_rgb();
+        for (int c = 0; c < 3; c++) {
+            changed += std::abs((int)a[c] - (int)b[c]) > 2;
+        }
+    }
+    assert(changed <= 3 * (int)full.size() / 100); // 1% of the channels
+    if (RenderStats::kEnabled) {
+        assert(adaptive_stats.counters.pbr_samples < full_stats.counters.pbr_samples);
+    }
+    std::cout << "Adaptive PBR sampling matched full sampling." << std::endl;
+}
+
+void test_thread_count() {
+    // Samples depend on the pixel, never on the thread tracing it, so any
+    // number of threads renders the same image
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<PBRMaterial>>(Point(0.25f, 0.45f, 0.4f), 0.2f, PBRMaterial(Color::raw(0.56, 0.57, 0.58), 0.3f, 1.0f, 0.5f, 16));
+    scene.add_shape<BasicPlane<PBRMaterial>>(Point(0.0f, 0.0f, -0.1f), Vector(0.0f, 0.0f, 1.0f), PBRMaterial(Color::from_rgb(200, 200, 200), 0.5f, 0.0f, 0.5f, 16));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    int threads = omp_get_max_threads();
+    for (SamplePattern pattern : { SamplePattern::Sobol, SamplePattern::OwenSobol, SamplePattern::BlueNoise }) {
+        RenderSettings settings;
+        settings.sampler = pattern;
+        scene.set_settings(settings);
+        omp_set_num_threads(1);
+        std::vector<Color> serial = scene.render(40, 40);
+        omp_set_num_threads(4);
+        std::vector<Color> parallel = scene.render(40, 40);
+        for (std::size_t i = 0; i < serial.size(); i++) {
+            assert(serial[i].get_raw() == parallel[i].get_raw());
+        }
+    }
+    omp_set_num_threads(threads);
+    std::cout << "Renders matched across thread counts." << std::endl;
+}
+
+void test_radiance_cache() {
+    RadianceCacheSettings settings;
+    settings.enabled = true;
+    settings.samples_per_entry = 2;
+    settings.capacity = 64;
+    RadianceCache cache;
+    cache.configure(settings);
+    Vector up(0.0f, 0.0f, 1.0f);
+    uint64_t key = cache.key(Point(0.01f, 0.01f, 0.0f), up, Vector(0.0f, 0.6f, 0.8f));
+    // Close enough to share the entry, but not in another direction bin
+    assert(cache.key(Point(0.02f, 0.03f, 0.0f), up, Vector(0.0f, 0.61f, 0.79f)) == key);
+    assert(cache.key(Point(0.01f, 0.01f, 0.0f), up, Vector(0.0f, -0.6f, 0.8f)) != key);
+    assert(!cache.find(key));
+    cache.add(key, Color::raw(1.0f, 0.0f, 0.0f));
+    assert(!cache.find(key)); // not enough samples yet
+    cache.add(key, Color::raw(0.0f, 1.0f, 0.0f));
+    assert(cache.find(key).value().get_rgb(1.0f) == Color::raw(0.5f, 0.5f, 0.0f).get_rgb(1.0f));
+    // Filling the cache with newer entries evicts the old one
+    cache.next_frame();
+    for (int i = 1; i <= 1000; i++) {
+        cache.add(cache.key(Point(i, 0.0f, 0.0f), up, up), Color::white());
+    }
+    assert(!cache.find(key));
+    cache.clear();
+    for (int i = 1; i <= 1000; i++) {
+        assert(!cache.find(cache.key(Point(i, 0.0f, 0.0f), up, up)));
+    }
+
+    // Reused estimates barely change the image, and the second frame
+    // reuses those of the first
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<>>(Point(0.25f, 0.45f, 0.3f), 0.2f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.0f));
+    scene.add_shape<BasicPlane<PBRMaterial>>(Point(0.0f, 0.0f, -0.1f), Vector(0.0f, 0.0f, 1.0f), PBRMaterial(Color::from_rgb(200, 200, 200), 0.5f, 1.0f));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    std::vector<Color> expected = scene.render(40, 40);
+    RenderSettings render_settings;
+    render_settings.radiance_cache.enabled = true;
+    scene.set_settings(render_settings);
+    RenderStats first_stats, second_stats;
+    scene.render(40, 40, &first_stats);
+    std::vector<Color> actual = scene.render(40, 40, &second_stats);
+    int changed = 0;
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        auto a = expected[i].get_rgb();
+        auto b = actual[i].get_rgb();
+        for (int c = 0; c < 3; c++) {
+            changed += std::abs((int)a[c] - (int)b[c]) > 4;
+        }
+    }
+    assert(changed <= 3 * (int)expected.size() / 100); // 1% of the channels
+    if (RenderStats::kEnabled) {
+        assert(second_stats.counters.cache_hits > first_stats.counters.cache_hits);
+        assert(second_stats.counters.reflection_rays < first_stats.counters.reflection_rays);
+    }
+    std::cout << "Radiance cache reused nearby estimates." << std::endl;
+}
+
+void test_progressive() {
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<>>(Point(0.25f, 0.45f, 0.3f), 0.2f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.5f));
+    scene.add_shape<BasicPlane<PBRMaterial>>(Point(0.0f, 0.0f, -0.1f), Vector(0.0f, 0.0f, 1.0f), PBRMaterial(Color::from_rgb(200, 200, 200), 0.5f, 1.0f, 0.5f, 4));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    RenderSettings settings;
+    settings.tile_size = 8;
+    scene.set_settings(settings);
+
+    // The first pass is a plain render
+    std::vector<Color> expected = scene.render(40, 40);
+    ProgressiveSettings progressive;
+    progressive.max_passes = 1;
+    std::vector<Color> actual = scene.render_progressive(40, 40, progressive);
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        assert(expected[i].get_rgb() == actual[i].get_rgb());
+    }
+
+    // Tiles of sky converge right away, tiles of the plane take more
+    // passes; every pass is published, and the result doesn't depend on
+    // the threads
+    progressive.max_passes = 32;
+    progressive.tolerance = 1.0f / 64;
+    std::vector<int> active;
+    RenderStats stats;
+    std::vector<Color> first = scene.render_progressive(40, 40, progressive, [&](ProgressiveFrame const& frame) {
+        assert(frame.passes == (int)active.size() + 1);
+        assert(frame.image.size() == expected.size());
+        active.push_back(frame.active_tiles);
+    }, &stats);
+    assert(stats.passes == (int)active.size());
+    assert(active[progressive.min_passes - 2] == 25); // of 5 x 5
+    assert(active[progressive.min_passes - 1] < 25 && active[progressive.min_passes - 1] > 0);
+    assert(std::is_sorted(active.rbegin(), active.rend()));
+    std::vector<Color> second = scene.render_progressive(40, 40, progressive);
+    for (std::size_t i = 0; i < first.size(); i++) {
+        assert(first[i].get_rgb() == second[i].get_rgb());
+    }
+
+    // Rendering leaves no state behind on the threads that did it: a ray
+    // traced on the same thread afterwards draws the same samples
+    Ray ray(camera.get_position(), !Vector(0.0f, 1.0f, -0.4f)); // hits the plane
+    Color before = scene.trace(ray, 6);
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(1); // so this thread renders every pass
+    scene.render_progressive(40, 40, progressive);
+    RenderSettings iterative = settings;
+    iterative.integrator = Integrator::Iterative;
+    iterative.antialiasing.max_depth = 1;
+    scene.set_settings(iterative);
+    scene.render(40, 40);
+    scene.set_settings(settings);
+    omp_set_num_threads(threads);
+    assert(scene.trace(ray, 6).get_raw() == before.get_raw());
+    assert(!GBuffer::active && !RayTree::active);
+
+    // A time budget stops the render, even without convergence
+    progressive.max_passes = 1 << 20;
+    progressive.tolerance = 0.0f;
+    progressive.time_budget = 50.0;
+    scene.render_progressive(40, 40, progressive, nullptr, &stats);
+    assert(stats.passes < progressive.max_passes && stats.milliseconds < 5000.0);
+    std::cout << "Progressive renders converged per tile." << std::endl;
+}
+
+void test_antialiasing() {
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<>>(Point(0.25f, 0.45f, 0.3f), 0.2f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.0f));
+    scene.add_shape<BasicSphere<>>(Point(0.7f, 0.6f, 0.6f), 0.15f, BasicMaterial(Color::from_rgb(50, 50, 200), 0.3f));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    std::vector<Color> aliased = scene.render(50, 50);
+    // Jittered passes converge to the box-filtered image
+    ProgressiveSettings progressive;
+    progressive.max_passes = 64;
+    progressive.tolerance = 0.0f;
+    std::vector<Color> expected = scene.render_progressive(50, 50, progressive);
+
+    RenderSettings settings;
+    settings.antialiasing.max_depth = 2;
+    scene.set_settings(settings);
+    RenderStats stats;
+    std::vector<Color> actual = scene.render(50, 50, &stats);
+    auto error = [&](std::vector<Color> const& image) {
+        int total = 0;
+        for (std::size_t i = 0; i < image.size(); i++) {
+            for (int c = 0; c < 3; c++) {
+                total += std::abs((int)image[i].get_rgb()[c] - (int)expected[i].get_rgb()[c]);
+            }
+        }
+        return total;
+    };
+    assert(error(actual) < error(aliased) / 2);
+    // Only pixels next to an edge are supersampled
+    int changed = 0;
+    for (int i = 0; i < 50; i++) {
+        for (int j = 0; j < 50; j++) {
+            if (actual[i * 50 + j].get_rgb() == aliased[i * 50 + j].get_rgb()) {
+                continue;
+            }
+            changed++;
+            bool edge = false;
+            for (auto [di, dj] : { std::pair(0, 1), std::pair(0, -1), std::pair(1, 0), std::pair(-1, 0) }) {
+                int k = (i + di) * 50 + j + dj;
+                if (i + di >= 0 && i + di < 50 && j + dj >= 0 && j + dj < 50 && aliased[k].get_rgb() != aliased[i * 50 + j].get_rgb()) {
+                    edge = true;
+                }
+            }
+            assert(edge);
+        }
+    }
+    assert(changed > 0 && changed < 2500 / 5);
+    if (RenderStats::kEnabled) {
+        assert(stats.counters.supersampled_pixels >= (uint64_t)changed);
+        assert(stats.counters.primary_rays <= 2500 + 16 * stats.counters.supersampled_pixels);
+    }
+    std::cout << "Adaptive antialiasing smoothed the edges only." << std::endl;
+}
+
+void test_denoiser() {
+    for (float x : { -80.0f, -10.0f, -1.0f, -0.3f, 0.0f, 0.5f, 3.0f }) {
+        float expected = std::exp(x);
+        assert(std::abs(packet_exp(packet_broadcast(x))[0] - expected) <= 1e-5f * expected);
+    }
+
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene reference(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    for (auto [target, samples] : { std::pair(&reference, 256), std::pair(&scene, 4) }) {
+        target->add_shape<BasicSphere<PBRMaterial>>(Point(0.25f, 0.45f, 0.4f), 0.2f, PBRMaterial(Color::raw(0.56, 0.57, 0.58), 0.5f, 1.0f, 0.5f, samples));
+        target->add_shape<BasicSphere<PBRMaterial>>(Point(0.7f, 0.6f, 0.3f), 0.15f, PBRMaterial(Color::from_rgb(200, 50, 50), 0.4f, 0.0f, 0.5f, samples));
+        target->add_shape<BasicPlane<PBRMaterial>>(Point(0.0f, 0.0f, -0.1f), Vector(0.0f, 0.0f, 1.0f), PBRMaterial(Color::from_rgb(200, 200, 200), 0.5f, 0.0f, 0.5f, samples));
+        target->add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    }
+    std::vector<Color> expected = reference.render(50, 50);
+
+    // The same samples at every pixel leave blotches, which filtering
+    // can't tell from detail; scrambled ones leave grain, which it removes
+    RenderSettings settings;
+    settings.sampler = SamplePattern::BlueNoise;
+    scene.set_settings(settings);
+    std::vector<Color> noisy = scene.render(50, 50);
+    settings.denoiser.enabled = true;
+    scene.set_settings(settings);
+    std::vector<Color> denoised = scene.render(50, 50);
+    auto error = [&](std::vector<Color> const& image) {
+        int total = 0;
+        for (std::size_t i = 0; i < image.size(); i++) {
+            for (int c = 0; c < 3; c++) {
+                total += std::abs((int)image[i].get_rgb()[c] - (int)expected[i].get_rgb()[c]);
+            }
+        }
+        return total;
+    };
+    assert(error(denoised) < error(noisy) * 4 / 5);
+    // The sky is left as it is
+    Color sky = Color::from_rgb(135, 206, 235);
+    for (std::size_t i = 0; i < noisy.size(); i++) {
+        if (noisy[i].get_rgb() == sky.get_rgb()) {
+            assert(denoised[i].get_rgb() == sky.get_rgb());
+        }
+    }
+    std::cout << "Denoising brought a noisy image closer to the reference." << std::endl;
+}
+
+void test_static_scene() {
+    // A static scene renders the same image as a dynamic one, including
+    // shapes that can only be shaded through `Material::get_color()`
+    auto pattern = [](float a, float b) {
+        return BasicMaterial(Color::from_rgb(200, 200, 200), (std::sin(10 * a) + std::sin(10 * b) + 2) / 4);
+    };
+    using Pattern = ParametricPlane<decltype(pattern)>;
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.8f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    StaticScene<BasicSphere<>, CustomSphere, Pattern> static_scene(
+        &camera, &screen, 0.8f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    static_assert(has_typed_shading<BasicSphere<>, decltype(static_scene)>::value);
+    static_assert(has_typed_shading<Pattern, decltype(static_scene)>::value);
+    static_assert(!has_typed_shading<CustomSphere, decltype(static_scene)>::value);
+    std::srand(221);
+    for (int i = 0; i < 40; i++) {
+        Point center(random_float(-1, 2), random_float(0, 3), random_float(0, 1));
+        float radius = random_float(0.05f, 0.2f);
+        if (i % 10 == 0) {
+            scene.add_shape<CustomSphere>(center, radius);
+            static_scene.add_shape<CustomSphere>(center, radius);
+        } else {
+            BasicMaterial material(Color::from_rgb(i * 6, 255 - i * 6, 128), 0.4f);
+            scene.add_shape<BasicSphere<>>(center, radius, material);
+            static_scene.add_shape<BasicSphere<>>(center, radius, material);
+        }
+    }
+    scene.add_shape<Pattern>(Point(0.0f, 0.0f, -0.1f), Vector(1.0f, 0.0f, 0.0f), Vector(1.0f, 1.0f, 0.0f), pattern);
+    static_scene.add_shape<Pattern>(Point(0.0f, 0.0f, -0.1f), Vector(1.0f, 0.0f, 0.0f), Vector(1.0f, 1.0f, 0.0f), pattern);
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    static_scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+
+    for (bool packets : { false, true }) {
+        RenderSettings settings;
+        settings.packets = packets;
+        scene.set_settings(settings);
+        static_scene.set_settings(settings);
+        std::vector<Color> expected = scene.render(40, 30);
+        std::vector<Color> actual = static_scene.render(40, 30);
+        for (std::size_t i = 0; i < expected.size(); i++) {
+            auto a = expected[i].get_rgb();
+            auto b = actual[i].get_rgb();
+            for (int c = 0; c < 3; c++) {
+                assert(std::abs((int)a[c] - (int)b[c]) <= 1); // SIMD rounding may differ slightly
+            }
+        }
+    }
+    std::cout << "Static scene matched the dynamic scene." << std::endl;
+}
+
+void test_aovs() {
+    // Halves round to nearest even, and cover subnormals and overflow
+    for (float x : { 0.0f, 1.0f, -2.5f, 65504.0f, 0.1f, 3e-7f }) {
+        float y = half_to_float(float_to_half(x));
+        assert(std::abs(y - x) <= std::abs(x) / 2048 || std::abs(y - x) <= 3e-8f);
+    }
+    assert(float_to_half(1.0f + 1.0f / 2048) == float_to_half(1.0f)); // tie, to even
+    assert(std::isinf(half_to_float(float_to_half(70000.0f))));
+    assert(std::isnan(half_to_float(float_to_half(std::numeric_limits<float>::quiet_NaN()))));
+
+    Camera camera(Point(0.5f, -1.5f, 0.5f), Vector(0.0f, 1.0f, 0.0f));
+    Screen screen(10.0f, 10.0f);
+    Scene scene(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    scene.add_shape<BasicSphere<>>(Point(0.5f, 0.5f, 0.4f), 0.3f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.5f));
+    scene.add_shape<BasicPlane<>>(Point(0.0f, 0.0f, 0.0f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::from_rgb(50, 200, 50), 0.0f));
+    scene.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    AOVSettings settings;
+    settings.position = true;
+    settings.lighting = true;
+    AOVBuffers aovs(settings);
+    std::vector<Color> image = scene.render_aovs(40, 40, aovs);
+    // The image is the same as without output variables
+    std::vector<Color> expected = scene.render(40, 40);
+    for (std::size_t p = 0; p < image.size(); p++) {
+        assert(image[p].get_rgb() == expected[p].get_rgb());
+    }
+    assert(aovs.shape_id[20 * 40 + 20] == 1); // the sphere, in the middle
+    assert(aovs.shape_id[39 * 40 + 20] == 2); // the plane, at the bottom
+    assert(aovs.shape_id[0] == 0 && std::isinf(aovs.depth.get(0))); // the sky
+    bool reflected = false;
+    for (std::size_t p = 0; p < image.size(); p++) {
+        // Direct and indirect light add up to the pixel, once clamped
+        Color sum = AOVBuffers::get_color(aovs.direct, p) + AOVBuffers::get_color(aovs.indirect, p);
+        sum.clamp();
+        for (int c = 0; c < 3; c++) {
+            assert(std::abs(sum.get_raw()[c] - image[p].get_raw()[c]) < 1e-5f);
+        }
+        reflected |= aovs.shape_id[p] == 1 && AOVBuffers::get_color(aovs.indirect, p).luminance() > 0.01f;
+        if (!aovs.shape_id[p]) {
+            continue;
+        }
+        Point position(aovs.position[0].get(p), aovs.position[1].get(p), aovs.position[2].get(p));
+        Vector normal(aovs.normal[0].get(p), aovs.normal[1].get(p), aovs.normal[2].get(p));
+        assert(approx_eq(~normal, 1.0f));
+        if (aovs.shape_id[p] == 1) {
+            assert(std::abs(~(position - Point(0.5f, 0.5f, 0.4f)) - 0.3f) < 1e-4f);
+        } else {
+            assert(std::abs(position.z) < 1e-4f);
+        }
+        assert(normal * (camera.get_position() - position) > 0);
+    }
+    assert(reflected);
+
+    // Lighting isn't clamped: next to a bright light, direct light alone
+    // saturates pixels, and reflections still add up on top of it
+    Scene bright(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    bright.add_shape<BasicSphere<>>(Point(0.5f, 0.5f, 0.4f), 0.3f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.5f));
+    bright.add_shape<BasicPlane<>>(Point(0.0f, 0.0f, 0.0f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::from_rgb(200, 200, 200), 0.5f));
+    bright.add_light<InverseSquarePointLight>(Point(0.5, 0.0, 0.3), Color::white(), 4.0f);
+    AOVBuffers saturated(settings);
+    std::vector<Color> clamped = bright.render_aovs(40, 40, saturated);
+    bool saturated_direct = false;
+    bool saturated_reflection = false;
+    for (std::size_t p = 0; p < clamped.size(); p++) {
+        Color direct = AOVBuffers::get_color(saturated.direct, p);
+        Color indirect = AOVBuffers::get_color(saturated.indirect, p);
+        Color sum = direct + indirect;
+        sum.clamp();
+        for (int c = 0; c < 3; c++) {
+            assert(std::abs(sum.get_raw()[c] - clamped[p].get_raw()[c]) < 1e-5f);
+            saturated_direct |= direct.get_raw()[c] > 1.5f;
+            saturated_reflection |= direct.get_raw()[c] > 1.0f && indirect.get_raw()[c] > 0.01f;
+        }
+    }
+    assert(saturated_direct && saturated_reflection);
+
+    // A static scene numbers its shapes the same way
+    StaticScene<BasicSphere<>, BasicPlane<>> fixed(&camera, &screen, 0.1f, 0.5f, 8., Color::from_rgb(135, 206, 235));
+    fixed.add_shape<BasicSphere<>>(Point(0.5f, 0.5f, 0.4f), 0.3f, BasicMaterial(Color::from_rgb(200, 50, 50), 0.5f));
+    fixed.add_shape<BasicPlane<>>(Point(0.0f, 0.0f, 0.0f), Vector(0.0f, 0.0f, 1.0f), BasicMaterial(Color::from_rgb(50, 200, 50), 0.0f));
+    fixed.add_light<BasicPointLight>(Point(0.0, -0.5, 1.0));
+    AOVBuffers fixed_aovs(settings);
+    fixed.render_aovs(40, 40, fixed_aovs);
+    assert(fixed_aovs.shape_id == aovs.shape_id);
+    fixed.update_bvh();
+    float t = std::numeric_limits<float>::infinity();
+    Shape const* sphere = fixed.intersect(Ray(camera.get_position(), Point(0.5f, 0.5f, 0.4f) - camera.get_position()), t);
+    assert(sphere && sphere->get_id() == 1);
+    t = std::numeric_limits<float>::infinity();
+    Shape const* plane = fixed.intersect(Ray(camera.get_position(), Vector(0.0f, 1.0f, -1.0f)), t);
+    assert(plane && plane->get_id() == 2);
+
+    // Half precision takes half the memory, for the same variables
+    settings.precision = AOVPrecision::Half;
+    AOVBuffers halves(settings);
+    scene.render_aovs(40, 40, halves);
+    assert(halves.bytes() < aovs.bytes() * 2 / 3);
+    for (std::size_t p = 0; p < image.size(); p++) {
+        assert(halves.shape_id[p] == aovs.shape_id[p]);
+        for (int c = 0; c < 3; c++) {
+            assert(std::abs(halves.albedo[c].get(p) - aovs.albedo[c].get(p)) < 1e-3f);
+        }
+    }
+    std::cout << "Output variables matched the render." << std::endl;
+}
+
+void test_image() {
+    int width = 300, height = 250; // more than one stored PNG block
+    std::vector<Color> data;
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            data.push_back(Color::from_rgb(i % 256, j % 256, (i * j) % 256));
+        }
+    }
+
+    std::vector<unsigned char> ppm = encode_image(data, width, height, ImageFormat::PPM);
+    std::string header = "P6\n300 250\n255\n";
+    assert(ppm.size() == header.size() + 3 * width * height);
+    assert(std::equal(header.begin(), header.end(), ppm.begin()));
+    std::size_t last = header.size() + 3 * (width * height - 1);
+    auto rgb = data.back().get_rgb();
+    assert(ppm[last] == (int)rgb[0] && ppm[last + 1] == (int)rgb[1] && ppm[last + 2] == (int)rgb[2]);
+
+    std::vector<unsigned char> pfm = encode_image(data, width, height, ImageFormat::PFM);
+    assert(pfm.size() == std::string("PF\n300 250\n-1.0\n").size() + 12 * width * height);
+
+    std::vector<unsigned char> png = encode_image(data, width, height, ImageFormat::PNG);
+    unsigned char const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    assert(std::equal(signature, signature + 8, png.begin()));
+    // IEND chunk has a fixed CRC
+    unsigned char const iend_crc[4] = { 0xAE, 0x42, 0x60, 0x82 };
+    assert(std::equal(iend_crc, iend_crc + 4, png.end() - 4));
+
+    assert(image_format_from_path("image.png") == ImageFormat::PNG);
+    assert(image_format_from_path("image.pfm") == ImageFormat::PFM);
+    assert(image_format_from_path("image.ppm") == ImageFormat::PPM);
+
+    // A frame submitted to the background writer reads back as its encoding
+    std::string path = "test_image_writer.png";
+    {
+        ImageWriter writer;
+        writer.submit(path, data, width, height);
+        assert(writer.wait());
+    }
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(path.c_str());
+    assert(written == png);
+
+    BenchConfig config;
+    config.image = "frames/pbr.png";
+    assert(config.image_path(4) == "frames/pbr-4.png");
+    config.image = "frames.d/pbr";
+    assert(config.image_path(1) == "frames.d/pbr-1");
+    std::cout << "Image encoders produced well-formed files, and ImageWriter saved one." << std::endl;
+}
+
+// Number of non-overlapping occurrences of `pattern` in `text`
+int count_occurrences(std::string const& text, std::string const& pattern) {
+    int count = 0;
+    for (std::size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + pattern.size())) {
+        count++;
+    }
+    return count;
+}
+
+// Number of cursor movement escapes (`ESC [ row ; column H`) in `text`
+int count_cursor_moves(std::string const& text) {
+    int count = 0;
+    for (std::size_t at = text.find("\033["); at != std::string::npos; at = text.find("\033[", at + 2)) {
+        std::size_t end = text.find_first_not_of("0123456789;", at + 2);
+        if (end != std::string::npos && end > at + 2 && text[end] == 'H') {
+            count++;
+        }
+    }
+    return count;
+}
+
+void test_terminal_frame() {
+    int width = 8, height = 4;
+    std::string const color = "\033[48;5;";
+    std::vector<int> cells(width * height, 16);
+    TerminalFrame frame;
+
+    // The first frame draws every cell, setting the color once
+    std::string out = frame.draw(cells, width, height, 0, "status");
+    assert(count_occurrences(out, "\033[2J") == 1);
+    assert(count_occurrences(out, color) == 1);
+    assert(count_occurrences(out, "  ") == width * height);
+
+    // Nothing changed: only the status line is rewritten
+    out = frame.draw(cells, width, height, 0, "status");
+    assert(count_occurrences(out, "\033[2J") == 0);
+    assert(count_occurrences(out, color) == 0);
+    assert(count_cursor_moves(out) == 1);
+
+    // One changed cell: one move to it (besides the status line's) and one color
+    cells[1 * width + 3] = 196;
+    out = frame.draw(cells, width, height, 0, "status");
+    assert(count_cursor_moves(out) == 2);
+    assert(count_occurrences(out, color) == 1);
+    assert(count_occurrences(out, "\033[2;7H" + color + "196m  ") == 1); // 1-based, two columns per cell
+
+    // A run of changed cells of one color: one move and one color code
+    for (int j = 2; j < 7; j++) {
+        cells[2 * width + j] = 46;
+    }
+    out = frame.draw(cells, width, height, 0, "status");
+    assert(count_cursor_moves(out) == 2);
+    assert(count_occurrences(out, color) == 1);
+    assert(count_occurrences(out, color + "46m" + std::string(2 * 5, ' ')) == 1);
+
+    // After invalidate(), the screen is cleared and redrawn
+    frame.invalidate();
+    out = frame.draw(cells, width, height, 0, "status");
+    assert(count_occurrences(out, "\033[2J") == 1);
+    assert(count_occurrences(out, "  ") == width * height);
+    std::cout << "Terminal frames only redrew changed cells." << std::endl;
+}
+
 int main() {
     Vector v1 = Vector(1.0f, 2.0f, 3.0f);
     Vector v2 = Vector(4.0f, 5.0f, 6.0f);
@@ -62,7 +1135,12 @@ int main() {
     assert(p1 == Point(2.0f, 4.0f, 6.0f));
     v1 = Vector(1.0f, 2.0f, 3.0f);
     assert(v1 == Vector(1.0f, 2.0f, 3.0f));
+    // The operators are usable in constant expressions
+    static_assert((Vector(1.0f, 2.0f, 3.0f) ^ Vector(4.0f, 5.0f, 6.0f)) == Vector(-3.0f, 6.0f, -3.0f));
+    static_assert(Point(1.0f, 2.0f, 3.0f) + 2.0f * Vector(1.0f, 0.0f, 0.0f) == Point(3.0f, 2.0f, 3.0f));
+    static_assert(lin_solve(Vector(1, 0, 0), Vector(0, 2, 0), Vector(0, 0, 4), Vector(1, 1, 1)) == Vector(1.0f, 0.5f, 0.25f));
     std::cout << "Vector and Point classes compiled successfully." << std::endl;
+    test_vector_batches();
 
     // Use 1.0f in Color::from_rgb() and Color::get_rgb() to disable
     // gamma correction, so that operation results are easier to predict
@@ -101,6 +1179,22 @@ int main() {
         && approx_eq(c3_rgb[2], 255.0f)); // b should be clamped to 255
 
     std::cout << "Color class compiled successfully." << std::endl;
+    test_bvh();
+    test_scheduler();
+    test_light_culling();
+    test_ray_generator();
+    test_pruning();
+    test_iterative();
+    test_pbr_sampling();
+    test_thread_count();
+    test_radiance_cache();
+    test_progressive();
+    test_antialiasing();
+    test_denoiser();
+    test_aovs();
+    test_static_scene();
+    test_image();
+    test_terminal_frame();
     test_scene();
     return 0;
 }
\ No newline at end of file
@@ -1,30 +1,27 @@
-#include <fstream>
+#include <chrono>
 #include <iostream>
 #include <sys/ioctl.h> // For terminal size detection
 #include <tuple>
+#include <utility>
 #include <unistd.h>
 
+#include "bench.hpp"
+#include "image.hpp"
+#include "terminal.hpp"
 #include "ui.hpp"
 #include "util.hpp"
 
 // Note compatibility requires a Unix-like system for terminal size detection
 
-void make_screen(Scene const& scene, int width, int height) {
-    std::ofstream Image("image.ppm");
-    Image << "P3" << std::endl; // P3 format .ppm file
-    // tells the file the length and width of the image
-    Image << width << " " << height << std::endl;
-    Image << "255" << std::endl; // RGB values rated out of 255
-
+void make_screen(SceneBase const& scene, int width, int height, std::string const& path) {
+    auto start_time = std::chrono::steady_clock::now();
     std::vector<Color> data = scene.render(width, height);
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            Color color = data[i * width + j];
-            std::array<float, 3> rgb = color.get_rgb();
-            Image << (int)rgb[0] << " " << (int)rgb[1] << " " << (int)rgb[2] << std::endl;
-        }
+    auto end_time = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+    std::cout << "Rendering completed in " << duration << " milliseconds." << std::endl;
+    if (!write_image(path, data, width, height)) {
+        std::cerr << "Failed to write " << path << std::endl;
     }
-    Image.close();
 }
 
 int get_terminal_width() {
@@ -39,10 +36,7 @@ int get_terminal_height() {
     return w.ws_row;
 }
 
-void make_screen_terminal(Scene const& scene) {
-    // Disable line wrap to avoid automatic wrapping in some terminals
-    std::cout << "\033[?7l";
-
+TerminalImage render_terminal_image(SceneBase const& scene, CancelToken const* cancel) {
     auto rgb_to_256 = [](int r, int g, int b) { // Helper function to convert RGB to 256-color index
         int rr = r / 51;
         int gg = g / 51;
@@ -61,33 +55,61 @@ void make_screen_terminal(Scene const& scene) {
     float aspect_ratio = width / length;
     term_width = std::max(1, (int)(term_height * aspect_ratio)); // adjust width
 
-    // Clear screen and move cursor home
-    std::cout << "\033[2J\033[H";
+    TerminalImage image;
+    image.width = term_width;
+    image.height = term_height;
+    // Add padding to center the image
+    image.padding = std::max(0, (raw_width - term_width * 2) / 2);
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::vector<Color> data = scene.render(term_width, term_height, nullptr, cancel);
+    auto end_time = std::chrono::steady_clock::now();
+    image.milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+
+    image.cells.resize(term_width * term_height);
+    for (int i = 0; i < term_width * term_height; i++) {
+        std::array<float, 3> rgb = data[i].get_rgb();
+        image.cells[i] = rgb_to_256((int)rgb[0], (int)rgb[1], (int)rgb[2]);
+    }
+    return image;
+}
+
+TerminalRenderJob::~TerminalRenderJob() {
+    this->stop();
+}
 
-    std::vector<Color> data = scene.render(term_width, term_height);
+void TerminalRenderJob::start(SceneBase const& scene) {
+    this->stop();
+    this->cancel.reset();
+    this->done.store(false);
+    this->worker = std::thread([this, &scene] {
+        this->result = render_terminal_image(scene, &this->cancel);
+        this->done.store(true);
+    });
+}
 
-    for (int i = 0; i < term_height; i++) {
-        // Add padding to center the image
-        int padding = (raw_width - (term_width) * 2) / 2;
-        for (int p = 0; p < padding; p++) {
-            std::cout << " ";
-        }
-        // Render each pixel in the row
-        for (int j = 0; j < term_width; j++) {
-            Color color = data[i * term_width + j];
-            std::array<float, 3> rgb = color.get_rgb();
-            int idx = rgb_to_256((int)rgb[0], (int)rgb[1], (int)rgb[2]);
-            std::cout << "\033[48;5;" << idx << "m  \033[0m"; // 256-color background
-        }
-        std::cout << std::endl;
+void TerminalRenderJob::stop() {
+    if (this->worker.joinable()) {
+        this->cancel.cancel();
+        this->worker.join();
     }
+}
 
-    // Re-enable line wrap
-    std::cout << "\033[?7h" << std::flush; // Ensure all output is printed
+bool TerminalRenderJob::running() const {
+    return this->worker.joinable();
 }
 
-void handle_input(Scene const& scene) {
-    Camera& camera = *scene.get_camera();
+bool TerminalRenderJob::finished() const {
+    return this->worker.joinable() && this->done.load();
+}
+
+TerminalImage TerminalRenderJob::take() {
+    this->worker.join();
+    return std::move(this->result);
+}
+
+// Move or turn the camera according to a key; return whether the key is a command
+bool move_camera(Camera& camera, char command) {
     auto camera_basis = [](const Vector& orientation) {
         Vector forward = !orientation;
         Vector world_up(0.0f, 0.0f, 1.0f);
@@ -100,76 +122,103 @@ void handle_input(Scene const& scene) {
         Vector up = !(right ^ forward);
         return std::tuple<Vector, Vector, Vector> { forward, right, up };
     };
-    make_screen_terminal(scene); // Initial render
+    auto [forward, right, up] = camera_basis(camera.get_orientation());
+    switch (command) {
+        case 'w':
+            camera.set_position(camera.get_position() + 0.1f * forward);
+            return true;
+        case 's':
+            camera.set_position(camera.get_position() - 0.1f * forward);
+            return true;
+        case 'a':
+            camera.set_position(camera.get_position() - 0.1f * right);
+            return true;
+        case 'd':
+            camera.set_position(camera.get_position() + 0.1f * right);
+            return true;
+        case 'r':
+            camera.set_position(camera.get_position() + 0.1f * up);
+            return true;
+        case 'f':
+            camera.set_position(camera.get_position() - 0.1f * up);
+            return true;
+        case 'i':
+            camera.set_orientation(!camera.get_orientation().rotate(right, kPi / 10.0f));
+            return true;
+        case 'k':
+            camera.set_orientation(!camera.get_orientation().rotate(right, -kPi / 10.0f));
+            return true;
+        case 'j':
+            camera.set_orientation(!camera.get_orientation().rotate(up, kPi / 10.0f));
+            return true;
+        case 'l':
+            camera.set_orientation(!camera.get_orientation().rotate(up, -kPi / 10.0f));
+            return true;
+        default:
+            return false;
+    }
+}
+
+void handle_input(SceneBase const& scene) {
+#ifdef RAYTRACER_BENCH
+    // Built by `make bench`: measure the scene instead of opening the viewer
+    std::cout << run_benchmark(scene, BenchConfig::from_environment()) << std::endl;
+#else
+    Camera& camera = *scene.get_camera();
+    std::string const prompt = "w/a/s/d to move, r/f to go up/down, i/j/k/l to look, q to quit";
+    // How often to check whether the render finished while waiting for keys
+    int const poll_interval_ms = 10;
+
+    RawInput input; // keys arrive immediately, without Enter
+    TerminalFrame frame;
+    TerminalRenderJob job;
+    TerminalImage image; // last finished render
+    std::string message; // shown before the prompt
+    auto present = [&] {
+        frame.present(image.cells, image.width, image.height, image.padding,
+            "[" + std::to_string(image.milliseconds) + " ms] " + message + prompt);
+    };
+    job.start(scene); // Initial render
 
     while (true) {
-        std::cout << "Enter command (w/a/s/d to move, r/f to go up/down, i/j/k/l to look, q to quit): ";
-        char command;
-        std::cin >> command;
-        switch (command) {
-            case 'w': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                camera.set_position(camera.get_position() + 0.1f * forward);
-                break;
-            }
-            case 's': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                camera.set_position(camera.get_position() - 0.1f * forward);
-                break;
-            }
-            case 'a': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                camera.set_position(camera.get_position() - 0.1f * right);
-                break;
-            }
-            case 'd': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                camera.set_position(camera.get_position() + 0.1f * right);
-                break;
-            }
-            case 'r': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                camera.set_position(camera.get_position() + 0.1f * up);
-                break;
-            }
-            case 'f': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                camera.set_position(camera.get_position() - 0.1f * up);
-                break;
-            }
-            case 'i': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                Vector new_orientation = !camera.get_orientation().rotate(right, kPi / 10.0f);
-                camera.set_orientation(new_orientation);
-                break;
-            }
-            case 'k': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                Vector new_orientation = !camera.get_orientation().rotate(right, -kPi / 10.0f);
-                camera.set_orientation(new_orientation);
-                break;
-            }
-            case 'j': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                Vector new_orientation = !camera.get_orientation().rotate(up, kPi / 10.0f);
-                camera.set_orientation(new_orientation);
-                break;
-            }
-            case 'l': {
-                auto [forward, right, up] = camera_basis(camera.get_orientation());
-                Vector new_orientation = !camera.get_orientation().rotate(up, -kPi / 10.0f);
-                camera.set_orientation(new_orientation);
-                break;
-            }
-            case 'q': {
-                make_screen(scene); // Save final image
-                return;
-            }
-            default: {
-                std::cout << "Unknown command" << std::endl;
-                break;
+        if (job.finished()) {
+            image = job.take();
+            present();
+            message.clear();
+        }
+
+        // Block until a key arrives if there's nothing else to wait for
+        std::string keys = input.read_keys(job.running() ? poll_interval_ms : -1);
+        if (keys.empty()) {
+            continue;
+        }
+        if (keys.find('q') != std::string::npos || keys.find('\0') != std::string::npos) {
+            job.stop();
+            std::cout << std::endl;
+            make_screen(scene); // Save final image
+            return;
+        }
+
+        // Apply all keys read so far to a copy of the camera, so that a
+        // burst of keys costs a single render
+        Camera next = camera;
+        bool moved = false;
+        for (char key : keys) {
+            if (move_camera(next, key)) {
+                moved = true;
+            } else {
+                message = "Unknown command. ";
             }
         }
-        make_screen_terminal(scene); // Re-render the scene after each command
+        if (moved) {
+            // The render reads the camera, so stop it before moving the camera
+            job.stop();
+            camera = next;
+            job.start(scene); // Re-render the scene with the new camera
+        } else if (!job.running()) {
+            present(); // only the message changed
+            message.clear();
+        }
     }
+#endif
 }
@@ -1,18 +1,72 @@
 #pragma once
 
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "scene.hpp"
 
 /**
- * @brief Render the scene and write the output into `image.ppm`.
+ * @brief Render the scene and write the output into `path`. The format is
+ * given by the extension (see `image_format_from_path()`): binary PPM by
+ * default, or PFM or PNG.
  */
-void make_screen(Scene const& scene, int width = 480, int height = 480);
+void make_screen(SceneBase const& scene, int width = 480, int height = 480, std::string const& path = "image.ppm");
 
 /**
- * @brief Render the scene and output to terminal.
+ * @brief An image rendered for the terminal, one color index per cell.
  */
-void make_screen_terminal(Scene const& scene);
+struct TerminalImage {
+    std::vector<int> cells; // xterm 256-color index of each cell, row by row
+    int width = 0;
+    int height = 0;
+    int padding = 0; // columns left of the image, to center it
+    long long milliseconds = 0; // time taken to render
+};
+
+/**
+ * @brief Render the scene at the size of the terminal.
+ * @param cancel If not null, the render stops early once it is set
+ */
+TerminalImage render_terminal_image(SceneBase const& scene, CancelToken const* cancel = nullptr);
+
+/**
+ * @brief Renders a terminal image on a background thread, so that the
+ * interactive loop keeps reading keys meanwhile. At most one render runs
+ * at a time; starting a new one cancels the previous one.
+ */
+class TerminalRenderJob {
+private:
+    std::thread worker;
+    CancelToken cancel;
+    std::atomic<bool> done { false };
+    TerminalImage result;
+
+public:
+    TerminalRenderJob() = default;
+    TerminalRenderJob(TerminalRenderJob const&) = delete;
+    TerminalRenderJob& operator=(TerminalRenderJob const&) = delete;
+    ~TerminalRenderJob(); // cancels the running render
+
+    /**
+     * @brief Start rendering `scene`, which must outlive the render and
+     * must not be modified (including its camera) until the render is
+     * taken or stopped.
+     */
+    void start(SceneBase const& scene);
+    void stop(); // cancel and wait for the running render, if any
+    bool running() const; // whether a render was started and not yet taken or stopped
+    bool finished() const; // whether the render is done and ready to be taken
+    TerminalImage take(); // wait for the render and return its result
+};
 
 /**
- * Implementation of input handling for camera movement (event loop)
+ * Implementation of input handling for camera movement (event loop).
+ * Keys are read in raw mode while the scene renders in the background;
+ * each key cancels the render in progress, and keys that arrive together
+ * are applied as a single camera update.
+ * When compiled with `-DRAYTRACER_BENCH` (see `make bench`), runs
+ * `run_benchmark()` on the scene instead and prints the JSON result.
  */
-void handle_input(Scene const& scene);
+void handle_input(SceneBase const& scene);
@@ -1,57 +1,223 @@
 #pragma once
 
-class Point { // Point definition
+#include <cmath>
+
+// Overloads for Vector and Point classes
+/*
+Vector Operations:
+
+-> Maps to vector <-
+- Addition: Vector + Vector
+- Subtraction: Vector - Vector
+- Scalar Multiplication: Vector * float, float * Vector
+- Scalar Division: Vector / float
+- Cross Product: Vector ^ Vector
+
+-> Maps to float <-
+- Dot Product: Vector * Vector
+- Magnitude: ~Vector
+
+-> Unary Operations <-
+- Negation: -Vector
+- Normalization: !Vector
+
+-> Equivalence Relation <-
+- Equality: Vector == Vector
+
+Point Operations:
+
+-> Maps to Point <-
+- Point Translation: Point + Vector, Point - Vector
+
+-> Equivalence Relation <-
+- Equality: Point == Point
+*/
+
+// Every operation is defined in this header, so that the compiler can
+// inline them into the hot loops and vectorize them there.
+//
+// Compiling with `RAYTRACER_ALIGNED_VECTORS` (`make ... ALIGNED=1`) pads
+// points and vectors to 16 bytes, aligned to 16 bytes, so that each one
+// fits in a single 4-wide SSE register.
+#ifdef RAYTRACER_ALIGNED_VECTORS
+#define VECTOR_ALIGNMENT alignas(16)
+#else
+#define VECTOR_ALIGNMENT
+#endif
+
+class VECTOR_ALIGNMENT Point { // Point definition
     public:
-        Point(float const x, float const y, float const z);
+        constexpr Point(float const x, float const y, float const z);
         float x;
-        float y; 
+        float y;
         float z;
+#ifdef RAYTRACER_ALIGNED_VECTORS
+        float w = 0.0f; // padding
+#endif
 };
 
-class Vector { // Vector definition
+class VECTOR_ALIGNMENT Vector { // Vector definition
     public:
-        Vector(float const x, float const y, float const z);
+        constexpr Vector(float const x, float const y, float const z);
         float x;
         float y;
         float z;
+#ifdef RAYTRACER_ALIGNED_VECTORS
+        float w = 0.0f; // padding
+#endif
         Vector rotate(Vector axis, float angle); // Intrinsic rotation of the vector
 };
 
-// Vector Operations 
-Vector operator+(Vector const& lhs, Vector const& rhs); // Vector addition
-Vector operator-(Vector const& lhs, Vector const& rhs); // Vector subtraction
-Vector operator^(Vector const& lhs, Vector const& rhs); // Cross product
-float operator*(Vector const& lhs, Vector const& rhs);  // Dot product
-float operator~(Vector const& vec);                     // Magnitude
-Vector operator-(Vector const& vec);                    // Negation
-Vector operator!(Vector const& vec);                    // Normalization
-bool operator==(Vector const& lhs, Vector const& rhs);  // Equality
+// Vector Operations
+constexpr Vector operator+(Vector const& lhs, Vector const& rhs); // Vector addition
+constexpr Vector operator-(Vector const& lhs, Vector const& rhs); // Vector subtraction
+constexpr Vector operator^(Vector const& lhs, Vector const& rhs); // Cross product
+constexpr float operator*(Vector const& lhs, Vector const& rhs);  // Dot product
+inline float operator~(Vector const& vec);                        // Magnitude
+constexpr Vector operator-(Vector const& vec);                    // Negation
+inline Vector operator!(Vector const& vec);                       // Normalization
+constexpr bool operator==(Vector const& lhs, Vector const& rhs);  // Equality
 
 // Scalar actions on Vectors
-Vector operator*(Vector const& vec, float scalar); // Scalar right-multiplication
-Vector operator*(float scalar, Vector const& vec); // Scalar left-multiplication
-Vector operator/(Vector const& vec, float scalar); // Scalar division
+constexpr Vector operator*(Vector const& vec, float scalar); // Scalar right-multiplication
+constexpr Vector operator*(float scalar, Vector const& vec); // Scalar left-multiplication
+constexpr Vector operator/(Vector const& vec, float scalar); // Scalar division
 
 // Projection operators
-Vector operator>>(Vector const& vec, Vector const& onto); // Projection of vec onto
-Vector operator<<(Vector const& onto, Vector const& vec); // Left-projection of vec onto
+constexpr Vector operator>>(Vector const& vec, Vector const& onto); // Projection of vec onto
+constexpr Vector operator<<(Vector const& onto, Vector const& vec); // Left-projection of vec onto
 
 // Point Operations
-Point operator+(Point const& point, Vector const& vec); // Point translation by vector
-Point operator+(Vector const& vec, Point const& point);
-Point operator-(Point const& point, Vector const& vec); // Point translation by negative vector
-Vector operator-(Point const& lhs, Point const& rhs);   // Vector from point difference
-bool operator==(Point const& lhs, Point const& rhs);    // Equality
+constexpr Point operator+(Point const& point, Vector const& vec); // Point translation by vector
+constexpr Point operator+(Vector const& vec, Point const& point);
+constexpr Point operator-(Point const& point, Vector const& vec); // Point translation by negative vector
+constexpr Vector operator-(Point const& lhs, Point const& rhs);   // Vector from point difference
+constexpr bool operator==(Point const& lhs, Point const& rhs);    // Equality
 
 // 3x3 determinant
-float determinant(Vector a, Vector b, Vector c);
+constexpr float determinant(Vector a, Vector b, Vector c);
 
 // Solve for linear combination coefficients (3x3 system of linear equations)
 /**
  * @brief Solve the system of linear equations Ax = b, where
  * A = (a1, a2, a3), assuming there is a unique solution.
- * 
+ *
  * Equivalently, solve for numbers x, y, z such that
  * x a1 + y a2 + z a3 = b.
  */
-Vector lin_solve(Vector a1, Vector a2, Vector a3, Vector b);
+constexpr Vector lin_solve(Vector a1, Vector a2, Vector a3, Vector b);
+
+// Vector Class Implementation
+constexpr Vector::Vector(float const xs, float const ys, float const zs)
+  : x(xs), y(ys), z(zs) {
+}
+
+constexpr Vector operator+(Vector const& lhs, Vector const& rhs) {
+    return Vector(lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z);
+}
+
+constexpr Vector operator-(Vector const& lhs, Vector const& rhs) {
+    return Vector(lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z);
+}
+
+/*
+ * Actions on Vectors
+ * Note multiple overloads to simulate commutativity where applicable
+ */
+
+constexpr Vector operator*(Vector const& vec, float scalar) {
+    return Vector(vec.x * scalar, vec.y * scalar, vec.z * scalar);
+}
+
+constexpr Vector operator*(float scalar, Vector const& vec) {
+    return Vector(vec.x * scalar, vec.y * scalar, vec.z * scalar);
+}
+
+constexpr Vector operator/(Vector const& vec, float scalar) {
+    return Vector(vec.x / scalar, vec.y / scalar, vec.z / scalar);
+}
+
+constexpr Vector operator^(Vector const& lhs, Vector const& rhs) {
+    return Vector(
+        lhs.y * rhs.z - lhs.z * rhs.y,
+        lhs.z * rhs.x - lhs.x * rhs.z,
+        lhs.x * rhs.y - lhs.y * rhs.x
+    );
+}
+
+constexpr float operator*(Vector const& lhs, Vector const& rhs) {
+    return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
+}
+
+inline float operator~(Vector const& vec) {
+    return std::sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
+}
+
+/*
+ * Unary Operations
+ */
+
+constexpr Vector operator-(Vector const& vec) {
+    return Vector(-vec.x, -vec.y, -vec.z);
+}
+
+inline Vector operator!(Vector const& vec) {
+    float mag = ~vec;
+    return Vector(vec.x / mag, vec.y / mag, vec.z / mag);
+}
+
+constexpr bool operator==(Vector const& lhs, Vector const& rhs) {
+    return (lhs.x == rhs.x) && (lhs.y == rhs.y) && (lhs.z == rhs.z);
+}
+
+constexpr Vector operator>>(Vector const& vec, Vector const& onto) {
+    float onto_mag_sq = onto * onto;
+    if (onto_mag_sq == 0.0f) {
+        return Vector(0.0f, 0.0f, 0.0f); // Avoid division by zero
+    }
+    float scalar = (vec * onto) / onto_mag_sq;
+    return scalar * onto;
+}
+
+constexpr Vector operator<<(Vector const& onto, Vector const& vec) {
+    return vec >> onto;
+}
+
+// Point Class Implementation
+constexpr Point::Point(float const xs, float const ys, float const zs)
+  : x(xs), y(ys), z(zs) {
+}
+
+constexpr Point operator+(Point const& point, Vector const& vec) {
+    return Point(point.x + vec.x, point.y + vec.y, point.z + vec.z);
+}
+
+constexpr Point operator+(Vector const& vec, Point const& point) {
+    return Point(point.x + vec.x, point.y + vec.y, point.z + vec.z);
+}
+
+constexpr Point operator-(Point const& point, Vector const& vec) {
+    return Point(point.x - vec.x, point.y - vec.y, point.z - vec.z);
+}
+
+constexpr bool operator==(Point const& lhs, Point const& rhs) {
+    return (lhs.x == rhs.x) && (lhs.y == rhs.y) && (lhs.z == rhs.z);
+}
+
+constexpr Vector operator-(Point const& lhs, Point const& rhs) {
+    return Vector(lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z);
+}
+
+constexpr float determinant(Vector a, Vector b, Vector c) {
+    return a.x * b.y * c.z + a.y * b.z * c.x + a.z * b.x * c.y
+        - a.x * b.z * c.y - a.y * b.x * c.z - a.z * b.y * c.x;
+}
+
+constexpr Vector lin_solve(Vector a1, Vector a2, Vector a3, Vector b) {
+    // Cramer's rule
+    float det = determinant(a1, a2, a3);
+    float det1 = determinant(b, a2, a3);
+    float det2 = determinant(a1, b, a3);
+    float det3 = determinant(a1, a2, b);
+    return Vector(det1 / det, det2 / det, det3 / det);
+}